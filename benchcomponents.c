@@ -1,4 +1,6 @@
 #include "headers.h"
+#include "indexes/btree.h"
+#include "indexes/hashtable.h"
 
 int get_nb_workers(void) {
    return 1;
@@ -6,41 +8,165 @@ int get_nb_workers(void) {
 
 #define NB_PAGECACHE_ACCESSES 10000000LU
 static struct pagecache *p;
+
+/* Access a page like the IO engine does: a page that is not cached is read (contains_data) before the next access */
+static int access_page(struct pagecache *p, uint64_t hash, int scan) {
+   void *page;
+   struct lru *lru;
+   int hit = get_page(p, hash, scan, &page, &lru);
+   if(!hit)
+      lru->contains_data = 1;
+   return hit;
+}
+
+/*
+ * Compare the indexes that can map pages to their location in the page cache, with the access pattern of bench_pagecache.
+ */
+void bench_pagecache_index(void) {
+   declare_timer;
+   struct index_entry e = {};
+   size_t nb_pages = MAX_PAGE_CACHE;
+   size_t nb_found;
+
+   btree_t *b = btree_create();
+   start_timer {
+      for(size_t i = 0; i < nb_pages; i++)
+         btree_insert(b, (unsigned char*)&i, sizeof(i), &e);
+   } stop_timer("BTREE - Fill: %lu ops, %lu ops/s", nb_pages, nb_pages*1000000LU/elapsed);
+   nb_found = 0;
+   start_timer {
+      for(size_t i = 0; i < NB_PAGECACHE_ACCESSES; i++) {
+         uint64_t hash = xorshf96() % nb_pages;
+         nb_found += btree_find(b, (unsigned char*)&hash, sizeof(hash), &e);
+      }
+   } stop_timer("BTREE - Hits: %lu ops, %lu ops/s (%lu found)", NB_PAGECACHE_ACCESSES, NB_PAGECACHE_ACCESSES*1000000LU/elapsed, nb_found);
+   nb_found = 0;
+   start_timer {
+      for(size_t i = 0; i < NB_PAGECACHE_ACCESSES; i++) {
+         uint64_t hash = xorshf96() + nb_pages;
+         nb_found += btree_find(b, (unsigned char*)&hash, sizeof(hash), &e);
+      }
+   } stop_timer("BTREE - Misses: %lu ops, %lu ops/s (%lu found)", NB_PAGECACHE_ACCESSES, NB_PAGECACHE_ACCESSES*1000000LU/elapsed, nb_found);
+   btree_free(b);
+
+   hashtable_t *h = hashtable_create(nb_pages);
+   start_timer {
+      for(size_t i = 0; i < nb_pages; i++)
+         hashtable_insert(h, i, &e);
+   } stop_timer("HASHTABLE - Fill: %lu ops, %lu ops/s", nb_pages, nb_pages*1000000LU/elapsed);
+   nb_found = 0;
+   start_timer {
+      for(size_t i = 0; i < NB_PAGECACHE_ACCESSES; i++) {
+         uint64_t hash = xorshf96() % nb_pages;
+         nb_found += (hashtable_lookup(h, hash) != NULL);
+      }
+   } stop_timer("HASHTABLE - Hits: %lu ops, %lu ops/s (%lu found)", NB_PAGECACHE_ACCESSES, NB_PAGECACHE_ACCESSES*1000000LU/elapsed, nb_found);
+   nb_found = 0;
+   start_timer {
+      for(size_t i = 0; i < NB_PAGECACHE_ACCESSES; i++) {
+         uint64_t hash = xorshf96() + nb_pages;
+         nb_found += (hashtable_lookup(h, hash) != NULL);
+      }
+   } stop_timer("HASHTABLE - Misses: %lu ops, %lu ops/s (%lu found)", NB_PAGECACHE_ACCESSES, NB_PAGECACHE_ACCESSES*1000000LU/elapsed, nb_found);
+   start_timer {
+      for(size_t i = 0; i < NB_PAGECACHE_ACCESSES; i++) { // evict the oldest page, cache a new one
+         hashtable_delete(h, i);
+         hashtable_insert(h, i + nb_pages, &e);
+      }
+   } stop_timer("HASHTABLE - Replace: %lu ops, %lu ops/s", NB_PAGECACHE_ACCESSES, NB_PAGECACHE_ACCESSES*1000000LU/elapsed);
+}
+
 void bench_pagecache(void) {
    declare_timer;
+   bench_pagecache_index();
    p = malloc(sizeof(*p));
-   page_cache_init(p);
+   page_cache_init(p, PAGE_SIZE, PAGE_CACHE_SIZE);
 
    start_timer {
-      void *page;
-      struct lru *lru;
       for(size_t i = 0; i < PAGE_CACHE_SIZE/PAGE_SIZE; i++) {
          uint64_t hash = i;
-         get_page(p, hash, &page, &lru);
+         access_page(p, hash, 0);
       }
    } stop_timer("Filling the page cache: %lu ops, %lu ops/s\n", PAGE_CACHE_SIZE/PAGE_SIZE, PAGE_CACHE_SIZE/PAGE_SIZE*1000000LU/elapsed);
 
    start_timer {
-      void *page;
-      struct lru *lru;
       for(size_t i = 0; i < NB_PAGECACHE_ACCESSES; i++) {
          uint64_t hash = xorshf96() % (PAGE_CACHE_SIZE/PAGE_SIZE);
-         get_page(p, hash, &page, &lru);
+         access_page(p, hash, 0);
       }
    } stop_timer("Accessing existing pages %lu ops, %lu ops/s\n", NB_PAGECACHE_ACCESSES, NB_PAGECACHE_ACCESSES*1000000LU/elapsed);
 
    start_timer {
-      void *page;
-      struct lru *lru;
       for(size_t i = 0; i < NB_PAGECACHE_ACCESSES; i++) {
          uint64_t hash = xorshf96() + PAGE_CACHE_SIZE/PAGE_SIZE;
-         get_page(p, hash, &page, &lru);
+         access_page(p, hash, 0);
       }
    } stop_timer("Accessing non cached pages %lu ops, %lu ops/s\n", NB_PAGECACHE_ACCESSES, NB_PAGECACHE_ACCESSES*1000000LU/elapsed);
 }
 
+/*
+ * Compare the replacement and admission policies of the page cache on a zipfian trace over NB_REPLACEMENT_ITEMS pages.
+ * Hit path = accesses to pages that are all cached, uniformly (no eviction), to measure the cost of a hit.
+ * Zipfian + scans = the same zipfian trace, but every SCAN_PERIOD accesses a scan reads SCAN_LENGTH pages that have never been accessed,
+ * the hit ratio is the one of the zipfian accesses.
+ */
+#define REPLACEMENT_CACHE_PAGES 65536LU
+#define NB_REPLACEMENT_ITEMS (10LU*REPLACEMENT_CACHE_PAGES)
+#define SCAN_PERIOD 100LU
+#define SCAN_LENGTH 100LU
+void bench_pagecache_replacement(void) {
+   declare_timer;
+   const char *names[] = { "LRU", "CLOCK" };
+   int policies[] = { PAGECACHE_LRU, PAGECACHE_CLOCK };
+   const char *admission_names[] = { "admit all", "scans at low priority", "TinyLFU" };
+   int admissions[] = { PAGECACHE_ADMIT_ALL, PAGECACHE_ADMIT_SCAN_LOW_PRIORITY, PAGECACHE_ADMIT_TINYLFU };
+
+   init_zipf_generator(0, NB_REPLACEMENT_ITEMS);
+   for(size_t i = 0; i < sizeof(policies)/sizeof(*policies); i++) {
+      for(size_t a = 0; a < sizeof(admissions)/sizeof(*admissions); a++) {
+         p = malloc(sizeof(*p));
+         page_cache_init(p, PAGE_SIZE, REPLACEMENT_CACHE_PAGES*PAGE_SIZE);
+         page_cache_set_policies(p, policies[i], admissions[a]);
+
+         for(size_t j = 0; j < REPLACEMENT_CACHE_PAGES; j++)
+            access_page(p, j, 0);
+
+         start_timer {
+            for(size_t j = 0; j < NB_PAGECACHE_ACCESSES; j++) {
+               uint64_t hash = xorshf96() % REPLACEMENT_CACHE_PAGES;
+               access_page(p, hash, 0);
+            }
+         } stop_timer("%s, %s - Hit path: %lu ops, %lu ops/s", names[i], admission_names[a], NB_PAGECACHE_ACCESSES, NB_PAGECACHE_ACCESSES*1000000LU/elapsed);
+
+         size_t nb_hits = 0;
+         start_timer {
+            for(size_t j = 0; j < NB_PAGECACHE_ACCESSES; j++) {
+               uint64_t hash = zipf_next();
+               nb_hits += access_page(p, hash, 0);
+            }
+         } stop_timer("%s, %s - Zipfian trace (%lu pages, cache of %lu pages): %lu ops, %lu ops/s, hit ratio %lu%%", names[i], admission_names[a], NB_REPLACEMENT_ITEMS, REPLACEMENT_CACHE_PAGES, NB_PAGECACHE_ACCESSES, NB_PAGECACHE_ACCESSES*1000000LU/elapsed, nb_hits*100LU/NB_PAGECACHE_ACCESSES);
+
+         nb_hits = 0;
+         uint64_t scanned_page = NB_REPLACEMENT_ITEMS + 1;
+         start_timer {
+            for(size_t j = 0; j < NB_PAGECACHE_ACCESSES; j++) {
+               uint64_t hash = zipf_next();
+               nb_hits += access_page(p, hash, 0);
+               if(j % SCAN_PERIOD == 0) {
+                  for(size_t k = 0; k < SCAN_LENGTH; k++)
+                     access_page(p, scanned_page++, 1);
+               }
+            }
+         } stop_timer("%s, %s - Zipfian + scans trace (%lu scanned pages): %lu ops, %lu ops/s, hit ratio %lu%%", names[i], admission_names[a], scanned_page - NB_REPLACEMENT_ITEMS - 1, NB_PAGECACHE_ACCESSES, NB_PAGECACHE_ACCESSES*1000000LU/elapsed, nb_hits*100LU/NB_PAGECACHE_ACCESSES);
+      }
+   }
+}
+
 int main(int argc, char **argv) {
-   bench_pagecache();
+   if(argc > 1 && !strcmp(argv[1], "replacement"))
+      bench_pagecache_replacement(); // ./benchcomponents replacement
+   else
+      bench_pagecache();
    return 0;
 }
 
@@ -0,0 +1,518 @@
+#include "headers.h"
+
+/*
+ * Background compaction of slabs (SLAB_COMPACTION).
+ *
+ * Slab files only grow and the spots of deleted items are only reused through the freelist, so after many deletions a slab is mostly made
+ * of free spots and scans read half empty pages. Each worker compacts its slabs that have more than COMPACTION_MIN_FREE_PERCENT free spots:
+ *  - The pages of the slab are scanned from the beginning to find free spots (tombstones).
+ *  - The items of the last page of the slab are moved one by one to the free spots that have been found. A move is an internal UPDATE of
+ *    the free spot: requests on the item wait until the move is done (begin_item_move), the old spot is then read again to check that the
+ *    item has not been modified by a request that was sent before the move (otherwise it is copied again), and the index is updated.
+ *  - Once the last page doesn't contain any item, it is cleared in the page cache and removed from the slab (last_item).
+ *  - When the scan reaches the last page, the file is truncated after the last page and the freelist is rebuilt from the free spots that
+ *    have not been used. While a slab is compacted, new items are appended at the end of the slab and the spots of deleted items are set
+ *    aside for the new freelist (compaction_free_item).
+ * The compaction is throttled: it does one page access at a time, at most COMPACTION_IOS_PER_SEC per second, and only when the worker has less
+ * than half of its queue depth of IOs in flight.
+ *
+ * If the process stops during a compaction, recovery keeps the most recent copy of the items that were being moved, and the freelist may
+ * contain spots that have been used by the compaction (add_item_async_cb1 skips them).
+ *
+ * Clustering (SLAB_CLUSTERING, cluster_slabs): items are appended to the slabs in the order in which they are inserted, so the items of a scan are spread
+ * over as many pages as there are items. Before being compacted, the slabs are then reorganized so that items that are adjacent in key order
+ * share pages: the items of the worker are enumerated in the order of the index (memory_index_worker_scan) and the next item of the slab is
+ * moved to the first spot that doesn't contain an item in key order yet (cluster_pos). If that spot contains another item, the other item is
+ * first moved to the end of the slab, and the spots that the items leave are made tombstones. The end of the slab then only contains free
+ * spots and the items that have been added during the clustering, the compaction truncates it. Clustering is not throttled.
+ */
+
+struct compaction {
+   struct slab_context *ctx;
+   struct slab **slabs;
+   size_t nb_slabs;
+   struct slab *slab;                  // slab being compacted, NULL if none
+   size_t items_per_page;
+   int busy;                           // a page access is in progress
+   uint64_t last_io;                   // time (cycles) of the last page access
+   struct slab_callback cb;            // page accesses of the compaction (scan, last page)
+
+   size_t scanned_pages;               // pages [0, scanned_pages) have been scanned
+   size_t *free_spots;                 // free spots in the scanned pages, not used yet
+   size_t nb_free_spots, max_free_spots;
+
+   struct slab_callback *move;         // item being moved to a free spot, NULL if none
+   struct migration *move_lock;
+   size_t move_src;                    // old spot of the item being moved
+
+   /* Clustering */
+   volatile int cluster_requested;     // set by cluster_slabs, reset by the worker when all its slabs have been clustered
+   size_t next_slab_to_cluster;
+   int clustering;                     // the slab is being clustered
+   int sorted;                         // the items of the slab have been moved in key order, the end of the slab is being compacted
+   size_t cluster_pos;                 // spots [0, cluster_pos) contain items in key order
+   struct index_scan keys;             // next keys of the worker in key order
+   size_t keys_pos;
+   uint64_t next_hash;
+   int last_keys;                      // keys contains the last keys of the worker
+   char key_item[sizeof(struct item_metadata) + sizeof(uint64_t)]; // to look up the keys in the index
+
+   size_t nb_compactions, moved_items, reclaimed_pages, clustered_slabs;
+};
+
+static struct compaction **compactions; // one per worker
+
+struct compaction *compaction_init(struct slab_context *ctx, int worker_id, struct slab **slabs, size_t nb_slabs) {
+   if(!compactions)
+      compactions = calloc(get_nb_workers(), sizeof(*compactions));
+   struct compaction *c = calloc(1, sizeof(*c));
+   c->ctx = ctx;
+   c->slabs = slabs;
+   c->nb_slabs = nb_slabs;
+   c->cb.scan = 1; // don't evict hot pages to cache the pages of the compaction
+   compactions[worker_id] = c;
+   return c;
+}
+
+static void add_free_spot(struct compaction *c, size_t idx) {
+   if(c->nb_free_spots == c->max_free_spots) {
+      c->max_free_spots = c->max_free_spots?c->max_free_spots*2:1024;
+      c->free_spots = realloc(c->free_spots, c->max_free_spots * sizeof(*c->free_spots));
+   }
+   c->free_spots[c->nb_free_spots++] = idx;
+}
+
+/* An item of the slab has been deleted during the compaction, its spot is free */
+void compaction_free_item(struct compaction *c, size_t idx, struct item_metadata *item) {
+   item->value_size = -1; // not linked to other free spots, see add_son_in_freelist
+   if(idx / c->items_per_page < c->scanned_pages) // otherwise the spot will be found by the scan, or removed with the last pages
+      add_free_spot(c, idx);
+}
+
+static size_t last_page(struct slab *s, size_t items_per_page) {
+   return s->last_item?(s->last_item - 1) / items_per_page:0;
+}
+
+/* Sparsest slab that is worth compacting, NULL if none */
+static struct slab *choose_slab(struct compaction *c) {
+   struct slab *best = NULL;
+   size_t best_pages = 0;
+   for(size_t i = 0; i < c->nb_slabs; i++) {
+      struct slab *s = c->slabs[i];
+      size_t free_pages = s->nb_free_items / (s->page_size / s->item_size);
+      if(s->nb_free_items * 100 < s->last_item * COMPACTION_MIN_FREE_PERCENT || free_pages < COMPACTION_MIN_FREE_PAGES)
+         continue;
+      if(free_pages > best_pages) {
+         best = s;
+         best_pages = free_pages;
+      }
+   }
+   return best;
+}
+
+/* Next slab to cluster, NULL if all the slabs have been clustered */
+static struct slab *choose_slab_to_cluster(struct compaction *c) {
+   while(c->next_slab_to_cluster < c->nb_slabs) {
+      struct slab *s = c->slabs[c->next_slab_to_cluster++];
+      if(s->nb_items > 1)
+         return s;
+   }
+   return NULL;
+}
+
+static void start_compaction(struct compaction *c, struct slab *s) {
+   c->slab = s;
+   c->items_per_page = s->page_size / s->item_size;
+   c->scanned_pages = 0;
+   c->nb_free_spots = 0;
+   reset_free_list(s); // the free spots are found again by the scan
+   s->compaction = c;
+}
+
+static void end_compaction(struct compaction *c) {
+   struct slab *s = c->slab;
+   size_t old_size = s->size_on_disk;
+   size_t nb_pages = (s->last_item + c->items_per_page - 1) / c->items_per_page;
+   if(nb_pages < 2)
+      nb_pages = 2;
+   if(nb_pages * s->page_size < s->size_on_disk && !slab_is_extending(s)) { // otherwise it will be truncated by the next compaction
+      if(ftruncate(s->fd, nb_pages * s->page_size))
+         perr("Cannot truncate slab (item size %lu) to %lu bytes", s->item_size, nb_pages * s->page_size);
+      s->size_on_disk = nb_pages * s->page_size;
+      s->nb_max_items = nb_pages * c->items_per_page;
+   }
+
+   s->compaction = NULL;
+   for(size_t i = 0; i < c->nb_free_spots; i++) {
+      if(c->free_spots[i] < s->last_item)
+         add_item_in_free_list_in_memory(s, c->free_spots[i]);
+   }
+   s->nb_free_items = s->nb_free_items_in_memory;
+   c->nb_free_spots = 0;
+   c->slab = NULL;
+   if(c->clustering)
+      c->clustered_slabs++;
+   else
+      c->nb_compactions++;
+   printf("[SLAB WORKER %d] %s slab of %lu B items: %lu MB -> %lu MB, %lu items, %lu free spots\n", get_worker(s), c->clustering?"Clustered":"Compacted", s->item_size, old_size / 1024 / 1024, s->size_on_disk / 1024 / 1024, s->nb_items, s->nb_free_items);
+}
+
+static void compaction_io_done(struct slab_callback *cb) {
+   struct compaction *c = cb->payload;
+   c->busy = 0;
+}
+
+/* Look for free spots in the next page */
+static void scan_page_read(struct slab_callback *cb) {
+   struct compaction *c = cb->payload;
+   struct slab *s = c->slab;
+   char *page = cb->lru_entry->page;
+   size_t first = c->scanned_pages * c->items_per_page;
+   int modified = 0;
+   for(size_t i = 0; i < c->items_per_page && first + i < s->last_item; i++) {
+      struct item_metadata *meta = (void*)&page[i * s->item_size];
+      if(meta->key_size != -1)
+         continue;
+      if(meta->value_size != -1) { // forget the free spots linked to this one, they will be found by the scan
+         meta->value_size = -1;
+         modified = 1;
+      }
+      add_free_spot(c, first + i);
+   }
+   c->scanned_pages++;
+   if(modified) {
+      cb->io_cb = compaction_io_done;
+      write_page_async(cb);
+   } else {
+      c->busy = 0;
+   }
+}
+
+/* Move an item of the slab from spot src to spot dst, the page of src is in memory. Requests on the item wait until the end of the move. */
+static void item_moved(struct slab_callback *move, void *item);
+static void move_item(struct compaction *c, struct item_metadata *meta, size_t src, size_t dst) {
+   struct slab *s = c->slab;
+   struct slab_callback *move = pool_alloc(sizeof(*move));
+   memset(move, 0, sizeof(*move));
+   move->cb = item_moved;
+   move->payload = c;
+   move->item = pool_alloc(s->item_size);
+   memcpy(move->item, meta, get_item_size((void*)meta));
+   move->action = ADD; // the spot doesn't contain the item
+   move->slab = s;
+   move->slab_idx = dst;
+   c->move = move;
+   c->move_src = src;
+   c->move_lock = begin_item_move(c->ctx, move, s, src);
+   update_item_async(move);
+}
+
+/* The item has been written in its new spot, read the old spot to check that it has not been modified in the meantime */
+static void last_page_read(struct slab_callback *cb);
+static void cluster_move_done(struct slab_callback *cb);
+static void item_moved(struct slab_callback *move, void *item) {
+   struct compaction *c = move->payload;
+   c->cb.slab = c->slab;
+   c->cb.slab_idx = c->move_src;
+   c->cb.io_cb = c->clustering && !c->sorted?cluster_move_done:last_page_read;
+   read_page_async(&c->cb);
+}
+
+/* Called when the page of the old spot has been read again, returns 0 if the item has been modified and is copied again */
+static int end_move(struct compaction *c, struct item_metadata *old) {
+   struct slab *s = c->slab;
+   struct slab_callback *move = c->move;
+   size_t size = get_item_size((void*)old);
+   size_t skip = offsetof(struct item_metadata, key_size); // the timestamp of the copy is newer
+   if(memcmp((char*)old + skip, (char*)move->item + skip, size - skip)) { // modified by a request sent before the move, copy it again
+      memcpy(move->item, old, size);
+      update_item_async(move);
+      return 0;
+   }
+   memory_index_delete(get_worker(s), move->item);
+   memory_index_add(move, move->item);
+   if(ITEM_CACHE)
+      item_cache_remove(get_itemcache(c->ctx), s, c->move_src);
+   end_item_move(c->move_lock);
+   pool_free(move->item);
+   pool_free(move);
+   c->move = NULL;
+   c->moved_items++;
+   return 1;
+}
+
+/*
+ * Move the last item of the last page of the slab to a free spot, or remove the page from the slab if it is empty.
+ * Called when the last page has been read, cb->slab_idx is an item of the page.
+ */
+static void last_page_read(struct slab_callback *cb) {
+   struct compaction *c = cb->payload;
+   struct slab *s = c->slab;
+   struct slab_context *ctx = c->ctx;
+   char *page = cb->lru_entry->page;
+   size_t page_num = cb->slab_idx / c->items_per_page;
+   size_t first = page_num * c->items_per_page;
+
+   if(c->move && !end_move(c, (void*)&page[(c->move_src - first) * s->item_size]))
+      return;
+
+   if(page_num != last_page(s, c->items_per_page)) { // items have been appended
+      c->busy = 0;
+      return;
+   }
+
+   int appending = 0;
+   for(size_t i = s->last_item - first; i > 0; i--) {
+      size_t idx = first + i - 1;
+      struct item_metadata *meta = (void*)&page[(idx - first) * s->item_size];
+      if(meta->key_size == 0) { // the item is being appended
+         appending = 1;
+         continue;
+      }
+      if(meta->key_size == -1)
+         continue;
+      index_entry_t *e = memory_index_lookup(get_worker(s), meta);
+      if(!e || e->slab != s || e->slab_idx != idx) // old copy of an item
+         continue;
+      if(!c->nb_free_spots || item_is_moving(ctx, meta)) { // wait for the scan or for the end of the migration of the item
+         c->busy = 0;
+         return;
+      }
+      move_item(c, meta, idx, c->free_spots[--c->nb_free_spots]);
+      return;
+   }
+
+   struct lru *lru = cb->lru_entry;
+   if(appending || lru->dirty_since || lru->queued_writes != lru->completed_writes) { // wait for the writes of the page
+      c->busy = 0;
+      return;
+   }
+   memset(page, 0, s->page_size); // same content as the truncated file
+   s->last_item = first;
+   c->reclaimed_pages++;
+   c->busy = 0;
+}
+
+/*
+ * Clustering.
+ */
+static void start_clustering(struct compaction *c) {
+   c->clustering = 1;
+   c->sorted = 0;
+   c->cluster_pos = 0;
+   c->keys_pos = c->keys.nb_entries = 0;
+   c->next_hash = 0;
+   c->last_keys = 0;
+}
+
+static struct item_metadata *item_in_page(struct compaction *c, char *page, size_t idx) {
+   return (void*)&page[(idx % c->items_per_page) * c->slab->item_size];
+}
+
+static void advance_cluster_pos(struct compaction *c) {
+   c->cluster_pos++;
+   c->scanned_pages = c->cluster_pos / c->items_per_page; // the spots of the items deleted before that are free (compaction_free_item)
+}
+
+/* The old spot of an item that has been moved has been read again, make it a tombstone */
+static void cluster_move_done(struct slab_callback *cb) {
+   struct compaction *c = cb->payload;
+   char *page = cb->lru_entry->page;
+   size_t src = c->move_src;
+   struct item_metadata *old = item_in_page(c, page, src);
+   size_t dst = c->move->slab_idx;
+   if(!end_move(c, old))
+      return;
+   if(dst == c->cluster_pos)
+      advance_cluster_pos(c);
+   old->rdt = get_rdt(c->ctx);
+   old->key_size = -1;
+   old->value_size = -1;
+   cb->io_cb = compaction_io_done;
+   write_page_async(cb);
+}
+
+/* Index entry of the current key in the slab being clustered, NULL if the key is not in the slab anymore */
+static index_entry_t *current_key(struct compaction *c) {
+   *(uint64_t*)&c->key_item[sizeof(struct item_metadata)] = c->keys.hashes[c->keys_pos];
+   index_entry_t *e = memory_index_lookup(get_worker(c->slab), c->key_item);
+   if(!e || e->slab != c->slab)
+      return NULL;
+   return e;
+}
+
+/* The page of the current key has been read, move the item to cluster_pos */
+static void cluster_item_read(struct slab_callback *cb) {
+   struct compaction *c = cb->payload;
+   char *page = cb->lru_entry->page;
+   index_entry_t *e = current_key(c);
+   if(!e || e->slab_idx != cb->slab_idx) { // deleted or moved in the meantime, look at it again
+      c->busy = 0;
+      return;
+   }
+   struct item_metadata *meta = item_in_page(c, page, cb->slab_idx);
+   if(item_is_moving(c->ctx, meta)) {
+      c->busy = 0;
+      return;
+   }
+   move_item(c, meta, cb->slab_idx, c->cluster_pos);
+}
+
+/* The page of cluster_pos has been read, free the spot if needed and read the item that goes there */
+static void cluster_pos_read(struct slab_callback *cb) {
+   struct compaction *c = cb->payload;
+   struct slab *s = c->slab;
+   char *page = cb->lru_entry->page;
+   struct item_metadata *meta = item_in_page(c, page, c->cluster_pos);
+   index_entry_t *e = current_key(c);
+   if(!e || e->slab_idx <= c->cluster_pos) { // deleted or moved in the meantime, look at it again
+      c->busy = 0;
+      return;
+   }
+   size_t src = e->slab_idx;
+
+   if(meta->key_size == -1) { // free spot
+      c->cb.slab_idx = src;
+      c->cb.io_cb = cluster_item_read;
+      read_page_async(&c->cb);
+      return;
+   }
+
+   if(meta->key_size != 0) {
+      e = memory_index_lookup(get_worker(s), meta);
+      if(e && e->slab == s && e->slab_idx == c->cluster_pos) { // another item, move it at the end of the slab
+         if(item_is_moving(c->ctx, meta)) {
+            c->busy = 0;
+            return;
+         }
+         move_item(c, meta, c->cluster_pos, append_item_idx(s));
+         return;
+      }
+   }
+
+   // Item being appended or old copy of an item that is being moved to another slab, don't wait for it
+   advance_cluster_pos(c);
+   c->busy = 0;
+}
+
+#define CLUSTER_KEYS_PER_STEP 1024
+
+/* Look for the next item of the slab in key order, returns 0 if the item needs IOs to be moved */
+static int cluster_next_key(struct compaction *c) {
+   for(size_t i = 0; i < CLUSTER_KEYS_PER_STEP; i++) {
+      if(c->keys_pos == c->keys.nb_entries) {
+         free(c->keys.hashes);
+         free(c->keys.entries);
+         c->keys.hashes = NULL;
+         c->keys.entries = NULL;
+         c->keys.nb_entries = c->keys_pos = 0;
+         if(c->last_keys) { // all the items are in key order, compact the end of the slab
+            c->sorted = 1;
+            c->scanned_pages = c->cluster_pos / c->items_per_page;
+            return 1;
+         }
+         c->keys = memory_index_worker_scan(get_worker(c->slab), c->next_hash, CLUSTER_KEYS_PER_STEP);
+         if(c->keys.nb_entries < CLUSTER_KEYS_PER_STEP || c->keys.hashes[c->keys.nb_entries - 1] == UINT64_MAX)
+            c->last_keys = 1;
+         else
+            c->next_hash = c->keys.hashes[c->keys.nb_entries - 1] + 1;
+         continue;
+      }
+
+      index_entry_t *e = current_key(c);
+      if(!e || e->slab_idx < c->cluster_pos) { // not in the slab
+         c->keys_pos++;
+      } else if(e->slab_idx == c->cluster_pos) { // already at the right place
+         c->keys_pos++;
+         advance_cluster_pos(c);
+      } else {
+         return 0;
+      }
+   }
+   return 1;
+}
+
+/* Called by the worker between batches of requests, does at most one page access */
+void compaction_step(struct compaction *c) {
+   if(c->busy || io_pending(get_io_context(c->ctx)) >= io_queue_depth(get_io_context(c->ctx)) / 2)
+      return;
+
+   uint64_t now;
+   rdtscll(now);
+   if(!c->cluster_requested && cycles_to_us(now - c->last_io) < 1000000 / COMPACTION_IOS_PER_SEC)
+      return;
+   c->last_io = now;
+
+   if(!c->slab) {
+      struct slab *s = NULL;
+      if(c->cluster_requested) {
+         s = choose_slab_to_cluster(c);
+         if(!s)
+            c->cluster_requested = 0;
+      } else if(SLAB_COMPACTION) {
+         s = choose_slab(c);
+      }
+      if(!s)
+         return;
+      start_compaction(c, s);
+      c->clustering = c->cluster_requested;
+      if(c->clustering)
+         start_clustering(c);
+   }
+
+   struct slab *s = c->slab;
+   c->cb.payload = c;
+   c->cb.slab = s;
+   if(c->clustering && !c->sorted) {
+      if(cluster_next_key(c))
+         return;
+      c->busy = 1;
+      c->cb.slab_idx = c->cluster_pos;
+      c->cb.io_cb = cluster_pos_read;
+      read_page_async(&c->cb);
+      return;
+   }
+
+   size_t last = last_page(s, c->items_per_page);
+   c->busy = 1;
+   if(c->scanned_pages > last || !s->last_item) {
+      c->busy = 0;
+      end_compaction(c);
+   } else if(!c->nb_free_spots || c->scanned_pages == last) {
+      c->cb.slab_idx = c->scanned_pages * c->items_per_page;
+      c->cb.io_cb = scan_page_read;
+      read_page_async(&c->cb);
+   } else {
+      c->cb.slab_idx = last * c->items_per_page;
+      c->cb.io_cb = last_page_read;
+      read_page_async(&c->cb);
+   }
+}
+
+/* Cluster all the slabs in key order, returns when all the workers are done */
+void cluster_slabs(void) {
+   if(!compactions)
+      die("Clustering needs SLAB_CLUSTERING or SLAB_COMPACTION in options.h\n");
+   for(size_t w = 0; w < get_nb_workers(); w++) {
+      compactions[w]->next_slab_to_cluster = 0;
+      __sync_synchronize();
+      compactions[w]->cluster_requested = 1;
+   }
+   for(size_t w = 0; w < get_nb_workers(); w++) {
+      while(compactions[w]->cluster_requested)
+         usleep(10000);
+   }
+}
+
+void print_compaction_stats(void) {
+   if(!compactions)
+      return;
+   size_t nb_compactions = 0, clustered_slabs = 0, moved_items = 0, reclaimed_pages = 0;
+   for(size_t w = 0; w < get_nb_workers(); w++) {
+      nb_compactions += compactions[w]->nb_compactions;
+      clustered_slabs += compactions[w]->clustered_slabs;
+      moved_items += compactions[w]->moved_items;
+      reclaimed_pages += compactions[w]->reclaimed_pages;
+   }
+   printf("#Compaction: %lu slabs compacted, %lu slabs clustered, %lu items moved, %lu pages reclaimed\n", nb_compactions, clustered_slabs, moved_items, reclaimed_pages);
+}
@@ -0,0 +1,12 @@
+#ifndef COMPACTION_H
+#define COMPACTION_H 1
+
+struct compaction;
+
+struct compaction *compaction_init(struct slab_context *ctx, int worker_id, struct slab **slabs, size_t nb_slabs);
+void compaction_step(struct compaction *c);
+void compaction_free_item(struct compaction *c, size_t idx, struct item_metadata *item);
+void cluster_slabs(void);
+void print_compaction_stats(void);
+
+#endif
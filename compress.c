@@ -0,0 +1,125 @@
+#include "headers.h"
+
+/*
+ * Fast LZ77 compression of pages, used by the compressed cache (compressedcache.c). Same format as LZF:
+ *  - 000LLLLL <L+1 literal bytes>
+ *  - LLLooooo oooooooo: copy L+2 bytes from offset o+1 back in the output (L = 1..6)
+ *  - 111ooooo LLLLLLLL oooooooo: copy L+9 bytes from offset o+1 back in the output
+ * Matches are found with a hash table of the last position of each 3-byte sequence, there is no search for a longer match: speed matters
+ * more than the compression ratio because pages are compressed on the critical path of the workers.
+ */
+
+#define LZ_HASH_LOG 12
+#define LZ_MAX_LIT (1 << 5)
+#define LZ_MAX_OFF (1 << 13)
+#define LZ_MAX_REF ((1 << 8) + (1 << 3))
+
+static inline uint32_t lz_hash(const uint8_t *p) {
+   uint32_t v = (p[0] << 16) | (p[1] << 8) | p[2];
+   return (v * 2654435761U) >> (32 - LZ_HASH_LOG);
+}
+
+size_t lz_compress(const void *in, size_t in_len, void *out, size_t out_len) {
+   uint16_t htab[1 << LZ_HASH_LOG]; // position + 1 of the last occurrence of a sequence, 0 if none
+   const uint8_t *ip = in, *in_start = in, *in_end = ip + in_len;
+   uint8_t *op = out, *out_end = op + out_len;
+   assert(in_len < (1 << 16));
+   memset(htab, 0, sizeof(htab));
+
+   if(out_len < 2)
+      return 0;
+   uint8_t *lit_ctrl = op++; // control byte of the current run of literals
+   size_t lit = 0;
+   while(ip + 2 < in_end) {
+      uint32_t h = lz_hash(ip);
+      const uint8_t *ref = in_start + htab[h] - 1;
+      size_t off = ip - ref - 1;
+      int match = htab[h] && off < LZ_MAX_OFF && ref[0] == ip[0] && ref[1] == ip[1] && ref[2] == ip[2];
+      htab[h] = ip - in_start + 1;
+
+      if(!match) {
+         if(op + 2 > out_end)
+            return 0;
+         *op++ = *ip++;
+         if(++lit == LZ_MAX_LIT) {
+            *lit_ctrl = lit - 1;
+            lit = 0;
+            lit_ctrl = op++;
+         }
+         continue;
+      }
+
+      size_t len = 3, max_len = in_end - ip;
+      if(max_len > LZ_MAX_REF)
+         max_len = LZ_MAX_REF;
+      while(len < max_len && ref[len] == ip[len])
+         len++;
+
+      if(op + 4 > out_end) // match + control byte of the next run of literals
+         return 0;
+      if(lit)
+         *lit_ctrl = lit - 1;
+      else
+         op--; // no literal before the match, drop the control byte
+      len -= 2;
+      if(len < 7) {
+         *op++ = (len << 5) | (off >> 8);
+      } else {
+         *op++ = (7 << 5) | (off >> 8);
+         *op++ = len - 7;
+      }
+      *op++ = off;
+      ip += len + 2;
+      lit = 0;
+      lit_ctrl = op++;
+   }
+
+   while(ip < in_end) {
+      if(op + 2 > out_end)
+         return 0;
+      *op++ = *ip++;
+      if(++lit == LZ_MAX_LIT) {
+         *lit_ctrl = lit - 1;
+         lit = 0;
+         lit_ctrl = op++;
+      }
+   }
+   if(lit)
+      *lit_ctrl = lit - 1;
+   else
+      op--;
+   return op - (uint8_t*)out;
+}
+
+size_t lz_decompress(const void *in, size_t in_len, void *out, size_t out_len) {
+   const uint8_t *ip = in, *in_end = ip + in_len;
+   uint8_t *op = out, *out_start = out, *out_end = op + out_len;
+   while(ip < in_end) {
+      size_t ctrl = *ip++;
+      if(ctrl < LZ_MAX_LIT) {
+         size_t len = ctrl + 1;
+         if(op + len > out_end || ip + len > in_end)
+            return 0;
+         memcpy(op, ip, len);
+         op += len;
+         ip += len;
+      } else {
+         size_t len = ctrl >> 5;
+         if(len == 7) {
+            if(ip >= in_end)
+               return 0;
+            len += *ip++;
+         }
+         len += 2;
+         if(ip >= in_end)
+            return 0;
+         const uint8_t *ref = op - ((ctrl & 0x1f) << 8) - *ip++ - 1;
+         if(ref < out_start || op + len > out_end)
+            return 0;
+         for(size_t i = 0; i < len; i++) // the reference may overlap the output
+            op[i] = ref[i];
+         op += len;
+      }
+   }
+   return op - out_start;
+}
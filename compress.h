@@ -0,0 +1,9 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H 1
+
+#include <stddef.h>
+
+size_t lz_compress(const void *in, size_t in_len, void *out, size_t out_len); // 0 if the result doesn't fit in out_len bytes
+size_t lz_decompress(const void *in, size_t in_len, void *out, size_t out_len); // 0 if the data is corrupted
+
+#endif
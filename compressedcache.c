@@ -0,0 +1,116 @@
+#include "headers.h"
+
+/*
+ * Compressed cache: second tier of the page cache of a worker (COMPRESSED_CACHE).
+ *
+ * Clean pages evicted from the page cache are compressed (compress.c) and appended to a circular log of COMPRESSED_CACHE_SIZE/nb_workers
+ * bytes. On a miss, the page cache looks in the compressed cache before reading the page from disk; a page that is found is decompressed in
+ * the page cache and removed from the compressed cache (the two tiers are exclusive, so the copy in the compressed cache is never stale:
+ * a page has to be in the page cache to be modified).
+ * When the log is full, the oldest compressed pages are overwritten (FIFO). Pages that don't compress to less than
+ * COMPRESSED_CACHE_MAX_SIZE bytes are not cached.
+ *
+ * Like the page cache, the compressed cache is owned by a worker and is not thread safe.
+ */
+
+#define COMPRESSED_CACHE_MAX_SIZE (PAGE_SIZE * 3 / 4)
+#define COMPRESSED_CACHE_MIN_SIZE 64 // used to size the index
+
+struct compressed_record {
+   uint64_t hash;
+   size_t offset, len;
+   int valid;                          // 0 if the page has been moved back to the page cache
+};
+
+struct compressedcache *compressed_cache_init(size_t cache_size) {
+   struct compressedcache *c = calloc(1, sizeof(*c));
+   c->arena_size = cache_size;
+   c->arena = malloc(cache_size);
+   c->max_records = cache_size / COMPRESSED_CACHE_MIN_SIZE + 1;
+   c->records = calloc(c->max_records, sizeof(*c->records));
+   c->index = hashtable_create(c->max_records);
+   c->buffer = malloc(COMPRESSED_CACHE_MAX_SIZE);
+   return c;
+}
+
+/* Forget the oldest compressed page */
+static void drop_oldest(struct compressedcache *c) {
+   struct compressed_record *r = &c->records[c->head];
+   if(r->valid) {
+      hashtable_delete(c->index, r->hash);
+      c->nb_pages--;
+      c->compressed_bytes -= r->len;
+   }
+   c->head = (c->head + 1) % c->max_records;
+   c->nb_records--;
+}
+
+/*
+ * Make room for len bytes at the end of the log. The log contains [oldest record, arena_size) + [0, write_pos), so records are dropped
+ * while the oldest one starts after write_pos and before write_pos + len.
+ */
+static size_t alloc_in_log(struct compressedcache *c, size_t len) {
+   if(c->write_pos + len > c->arena_size) { // wrap around, the end of the arena is lost
+      while(c->nb_records && c->records[c->head].offset >= c->write_pos)
+         drop_oldest(c);
+      c->write_pos = 0;
+   }
+   while(c->nb_records && c->records[c->head].offset >= c->write_pos && c->records[c->head].offset < c->write_pos + len)
+      drop_oldest(c);
+   if(c->nb_records == c->max_records)
+      drop_oldest(c);
+   size_t offset = c->write_pos;
+   c->write_pos += len;
+   return offset;
+}
+
+/* A clean page has been evicted from the page cache */
+void compressed_cache_add(struct compressedcache *c, uint64_t hash, void *page) {
+   struct index_entry *old = hashtable_lookup(c->index, hash);
+   if(old) { // cannot happen, the page would have been moved back to the page cache when it was accessed
+      struct compressed_record *r = old->lru;
+      r->valid = 0;
+      c->nb_pages--;
+      c->compressed_bytes -= r->len;
+      hashtable_delete(c->index, hash);
+   }
+
+   size_t len = lz_compress(page, PAGE_SIZE, c->buffer, COMPRESSED_CACHE_MAX_SIZE);
+   if(!len) {
+      c->rejected++;
+      return;
+   }
+
+   size_t offset = alloc_in_log(c, len);
+   memcpy(&c->arena[offset], c->buffer, len);
+   size_t r_idx = (c->head + c->nb_records) % c->max_records;
+   struct compressed_record *r = &c->records[r_idx];
+   r->hash = hash;
+   r->offset = offset;
+   r->len = len;
+   r->valid = 1;
+   c->nb_records++;
+   c->nb_pages++;
+   c->compressed_bytes += len;
+
+   struct index_entry e = { .page = &c->arena[offset], .lru = r };
+   hashtable_insert(c->index, hash, &e);
+}
+
+/* Page cache miss: decompress the page in page if it is cached, returns 1 on a hit */
+int compressed_cache_get(struct compressedcache *c, uint64_t hash, void *page) {
+   struct index_entry *e = hashtable_lookup(c->index, hash);
+   if(!e) {
+      c->misses++;
+      return 0;
+   }
+   struct compressed_record *r = e->lru;
+   if(lz_decompress(e->page, r->len, page, PAGE_SIZE) != PAGE_SIZE)
+      die("Corrupted page in the compressed cache (hash %lu)\n", hash);
+   r->valid = 0;
+   c->nb_pages--;
+   c->compressed_bytes -= r->len;
+   hashtable_delete(c->index, hash);
+   c->hits++;
+   return 1;
+}
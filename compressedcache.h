@@ -0,0 +1,24 @@
+#ifndef COMPRESSED_CACHE_H
+#define COMPRESSED_CACHE_H 1
+
+#include "indexes/hashtable.h"
+
+struct compressed_record;
+
+struct compressedcache {
+   hashtable_t *index;                 // hash of the page -> compressed copy (.page = data, .lru = record)
+   char *arena;                        // circular log of compressed pages
+   size_t arena_size, write_pos;
+   struct compressed_record *records;  // FIFO of the compressed pages, in the order of the log
+   size_t max_records, head, nb_records;
+   char *buffer;                       // a page is compressed here before being copied in the log
+   size_t nb_pages, compressed_bytes;  // pages currently cached and their compressed size
+   size_t hits, misses, rejected;      // rejected: pages that don't compress well enough
+   size_t reported_hits, reported_misses;
+};
+
+struct compressedcache *compressed_cache_init(size_t cache_size);
+void compressed_cache_add(struct compressedcache *c, uint64_t hash, void *page);
+int compressed_cache_get(struct compressedcache *c, uint64_t hash, void *page);
+
+#endif
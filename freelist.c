@@ -11,6 +11,11 @@ struct freelist_entry {
 };
 
 void add_item_in_free_list(struct slab *s, size_t idx, struct item_metadata *item) {
+   if(s->compaction) { // the freelist is rebuilt at the end of the compaction
+      compaction_free_item(s->compaction, idx, item);
+      return;
+   }
+
    struct freelist_entry *new_entry;
    if(s->nb_free_items_in_memory >= FREELIST_IN_MEMORY_ITEMS) {
       new_entry = s->freed_items_tail;
@@ -35,7 +40,7 @@ void add_item_in_free_list(struct slab *s, size_t idx, struct item_metadata *ite
 }
 
 void add_son_in_freelist(struct slab *s, size_t idx, struct item_metadata *item) {
-   assert(s->nb_free_items_in_memory < FREELIST_IN_MEMORY_ITEMS);
+   // No assert on FREELIST_IN_MEMORY_ITEMS: after a compaction, all the free spots of the slab are in memory (reset_free_list)
 
    if(item->value_size != -1) {
       struct freelist_entry *new_entry = calloc(1, sizeof(*new_entry));
@@ -51,6 +56,33 @@ void add_son_in_freelist(struct slab *s, size_t idx, struct item_metadata *item)
    }
 }
 
+/*
+ * Compaction (compaction.c): forget the freelist while the slab is compacted, then rebuild it in memory from the free spots that remain.
+ */
+void reset_free_list(struct slab *s) {
+   struct freelist_entry *e = s->freed_items;
+   while(e) {
+      struct freelist_entry *next = e->next;
+      free(e);
+      e = next;
+   }
+   s->freed_items = s->freed_items_tail = NULL;
+   s->nb_free_items = 0;
+   s->nb_free_items_in_memory = 0;
+}
+
+void add_item_in_free_list_in_memory(struct slab *s, size_t idx) {
+   struct freelist_entry *new_entry = calloc(1, sizeof(*new_entry));
+   new_entry->slab_idx = idx;
+   new_entry->next = s->freed_items;
+   if(s->freed_items)
+      s->freed_items->prev = new_entry;
+   s->freed_items = new_entry;
+   if(!s->freed_items_tail)
+      s->freed_items_tail = new_entry;
+   s->nb_free_items_in_memory++;
+}
+
 void get_free_item_idx(struct slab_callback *cb) {
    if(!cb->slab->nb_free_items_in_memory) {
       cb->slab_idx = -1;
@@ -133,17 +165,8 @@ void add_item_in_free_list_recovery(struct slab *s, size_t idx, struct item_meta
 static void btree_iterator(uint64_t h, void *data) {
    struct slab *s = data;
    struct index_entry e;
-   if(!btree_find(s->freed_items_pointed_to, (unsigned char*)(&h), sizeof(h), &e)) {
-      struct freelist_entry *new_entry = calloc(1, sizeof(*new_entry));
-      new_entry->slab_idx = h;
-      new_entry->next = s->freed_items;
-      if(s->freed_items)
-         s->freed_items->prev = new_entry;
-      s->freed_items = new_entry;
-      if(!s->freed_items_tail)
-         s->freed_items_tail = new_entry;
-      s->nb_free_items_in_memory++;
-   }
+   if(!btree_find(s->freed_items_pointed_to, (unsigned char*)(&h), sizeof(h), &e))
+      add_item_in_free_list_in_memory(s, h);
 }
 
 void rebuild_free_list(struct slab *s) {
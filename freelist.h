@@ -5,6 +5,8 @@ struct freelist_entry;
 void add_item_in_free_list(struct slab *s, size_t idx, struct item_metadata *item);
 void add_son_in_freelist(struct slab *s, size_t idx, struct item_metadata *item);
 void get_free_item_idx(struct slab_callback *cb);
+void reset_free_list(struct slab *s);
+void add_item_in_free_list_in_memory(struct slab *s, size_t idx);
 
 void add_item_in_free_list_recovery(struct slab *s, size_t idx, struct item_metadata *item);
 void rebuild_free_list(struct slab *s);
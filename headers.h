@@ -20,20 +20,28 @@
 #include <signal.h>
 #include <sys/syscall.h>
 #include <linux/aio_abi.h>
+#include <linux/io_uring.h>
 
 #include "options.h"
 
 #include "utils.h"
+#include "pool.h"
 #include "items.h"
 
 #include "pagecache.h"
+#include "itemcache.h"
+#include "compress.h"
+#include "compressedcache.h"
+#include "numa.h"
 #include "in-memory-index-generic.h"
 #include "ioengine.h"
 #include "slab.h"
 #include "slabworker.h"
+#include "slabclasses.h"
 
 #include "stats.h"
 #include "freelist.h"
+#include "compaction.h"
 
 #include "workload-common.h"
 
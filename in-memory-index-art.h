@@ -9,11 +9,13 @@
 #define memory_index_lookup art_worker_lookup
 #define memory_index_delete art_worker_delete
 #define memory_index_scan art_init_scan
+#define memory_index_worker_scan art_worker_scan
 
 void art_init(void);
 struct index_entry *art_worker_lookup(int worker_id, void *item);
 void art_worker_delete(int worker_id, void *item);
 struct index_scan art_init_scan(void *item, size_t scan_size);
+struct index_scan art_worker_scan(int worker_id, uint64_t hash, size_t scan_size);
 void art_index_add(struct slab_callback *cb, void *item);
 
 #endif
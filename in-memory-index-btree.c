@@ -101,6 +101,16 @@ struct index_scan btree_init_scan(void *item, size_t scan_size) {
    return scan_res;
 }
 
+/*
+ * Returns up to scan_size keys >= hash in the index of a worker, in the order of the scans (compaction.c clusters slabs in that order).
+ */
+struct index_scan btree_worker_scan(int worker_id, uint64_t hash, size_t scan_size) {
+   pthread_spin_lock(&items_location_locks[worker_id]);
+   struct index_scan res = btree_find_n(items_locations[worker_id], (unsigned char *)&(hash), sizeof(hash), scan_size);
+   pthread_spin_unlock(&items_location_locks[worker_id]);
+   return res;
+}
+
 /*struct index_scan btree_init_scan(void *item, size_t scan_size) {
    struct index_scan scan_res;
    size_t nb_workers = get_nb_workers();
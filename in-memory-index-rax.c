@@ -55,6 +55,12 @@ struct index_scan rax_init_scan(void *item, size_t scan_size) {
    return scan_res;
 }
 
+struct index_scan rax_worker_scan(int worker_id, uint64_t hash, size_t scan_size) {
+   struct index_scan scan_res;
+   die("Not implemented");
+   return scan_res;
+}
+
 void rax_init(void) {
    items_locations = malloc(get_nb_workers() * sizeof(*items_locations));
    items_location_locks = malloc(get_nb_workers() * sizeof(*items_location_locks));
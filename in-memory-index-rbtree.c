@@ -82,6 +82,26 @@ struct index_scan rbtree_init_scan(void *item, size_t scan_size) {
    return scan_res;
 }
 
+/*
+ * Returns up to scan_size keys >= hash in the index of a worker, in the order of the scans (compaction.c clusters slabs in that order).
+ */
+struct index_scan rbtree_worker_scan(int worker_id, uint64_t hash, size_t scan_size) {
+   pthread_spin_lock(&items_location_locks[worker_id]);
+   struct rbtree_scan_tmp tmp = rbtree_lookup_n(items_locations[worker_id], (void*)hash, scan_size, pointer_cmp);
+   pthread_spin_unlock(&items_location_locks[worker_id]);
+
+   struct index_scan res;
+   res.entries = malloc(scan_size * sizeof(*res.entries));
+   res.hashes = malloc(scan_size * sizeof(*res.hashes));
+   for(size_t i = 0; i < tmp.nb_entries; i++) {
+      res.entries[i] = tmp.entries[i].value;
+      res.hashes[i] = (uint64_t)tmp.entries[i].key;
+   }
+   res.nb_entries = tmp.nb_entries;
+   free(tmp.entries);
+   return res;
+}
+
 void rbtree_init(void) {
    items_locations = malloc(get_nb_workers() * sizeof(*items_locations));
    items_location_locks = malloc(get_nb_workers() * sizeof(*items_location_locks));
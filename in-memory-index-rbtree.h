@@ -9,11 +9,13 @@
 #define memory_index_lookup rbtree_worker_lookup
 #define memory_index_delete rbtree_worker_delete
 #define memory_index_scan rbtree_init_scan
+#define memory_index_worker_scan rbtree_worker_scan
 
 void rbtree_init(void);
 struct index_entry *rbtree_worker_lookup(int worker_id, void *item);
 void rbtree_worker_delete(int worker_id, void *item);
 struct index_scan rbtree_init_scan(void *item, size_t scan_size);
+struct index_scan rbtree_worker_scan(int worker_id, uint64_t hash, size_t scan_size);
 void rbtree_index_add(struct slab_callback *cb, void *item);
 
 #endif
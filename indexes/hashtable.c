@@ -0,0 +1,212 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <sys/types.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "hashtable.h"
+
+/*
+ * Fixed capacity open-addressing hash table, uint64_t -> struct index_entry.
+ * Used as the index of the page cache (PAGECACHE_INDEX == HASHTABLE): keys are never scanned in order and the page cache never holds more than
+ * max_pages entries, so the table is allocated once with at least 2*max_entries slots and never grows.
+ *
+ * Slots are grouped by 16. Each slot has a control byte: HASHTABLE_EMPTY, HASHTABLE_DELETED, or a 7 bits tag computed from the hash of the key.
+ * A lookup compares the tag with the 16 control bytes of a group at once (SSE2) and only reads the keys whose tag matches. Groups are probed
+ * quadratically until a group with an empty slot is found.
+ * A deleted slot becomes empty again if its group still has an empty slot (no lookup ever probed past the group), otherwise it becomes a tombstone.
+ * When tombstones take a quarter of the slots, the keys are rehashed in place to get rid of them (no allocation after hashtable_create).
+ */
+#define HASHTABLE_GROUP 16
+#define HASHTABLE_EMPTY 0x80
+#define HASHTABLE_DELETED 0xFE
+
+struct hashtable {
+   uint8_t *ctrl;
+   uint64_t *keys;
+   struct index_entry *entries;
+   size_t nb_groups;             // Power of 2
+   size_t nb_entries;
+   size_t nb_deleted;
+};
+
+static uint64_t hash_key(uint64_t key) { // murmur3 finalizer
+   key ^= key >> 33;
+   key *= 0xff51afd7ed558ccdLU;
+   key ^= key >> 33;
+   key *= 0xc4ceb9fe1a85ec53LU;
+   key ^= key >> 33;
+   return key;
+}
+
+/* Bitmask of the slots of the group whose control byte is equal to byte */
+static inline unsigned group_match(const uint8_t *ctrl, uint8_t byte) {
+#ifdef __SSE2__
+   __m128i group = _mm_load_si128((const __m128i*)ctrl);
+   return _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(byte)));
+#else
+   unsigned mask = 0;
+   for(size_t i = 0; i < HASHTABLE_GROUP; i++)
+      if(ctrl[i] == byte)
+         mask |= 1U << i;
+   return mask;
+#endif
+}
+
+/* Bitmask of the empty or deleted slots of the group (control bytes with the high bit set) */
+static inline unsigned group_match_free(const uint8_t *ctrl) {
+#ifdef __SSE2__
+   return _mm_movemask_epi8(_mm_load_si128((const __m128i*)ctrl));
+#else
+   unsigned mask = 0;
+   for(size_t i = 0; i < HASHTABLE_GROUP; i++)
+      if(ctrl[i] & 0x80)
+         mask |= 1U << i;
+   return mask;
+#endif
+}
+
+static void hashtable_alloc(struct hashtable *h, size_t nb_groups) {
+   size_t nb_slots = nb_groups * HASHTABLE_GROUP;
+   h->nb_groups = nb_groups;
+   h->ctrl = aligned_alloc(HASHTABLE_GROUP, nb_slots);
+   h->keys = malloc(nb_slots * sizeof(*h->keys));
+   h->entries = malloc(nb_slots * sizeof(*h->entries));
+   if(!h->ctrl || !h->keys || !h->entries) {
+      fprintf(stderr, "Cannot allocate a hash table of %lu slots\n", nb_slots);
+      exit(-1);
+   }
+   memset(h->ctrl, HASHTABLE_EMPTY, nb_slots);
+   h->nb_entries = 0;
+   h->nb_deleted = 0;
+}
+
+hashtable_t *hashtable_create(size_t max_entries) {
+   struct hashtable *h = calloc(1, sizeof(*h));
+   size_t nb_groups = 1;
+   while(nb_groups * HASHTABLE_GROUP < 2 * max_entries)
+      nb_groups *= 2;
+   hashtable_alloc(h, nb_groups);
+   return h;
+}
+
+/* Memory used by the table, in bytes */
+size_t hashtable_memory(hashtable_t *h) {
+   return h->nb_groups * HASHTABLE_GROUP * (sizeof(*h->ctrl) + sizeof(*h->keys) + sizeof(*h->entries));
+}
+
+/* Slot of the key, -1 if the key is not in the table */
+static ssize_t find_slot(struct hashtable *h, uint64_t key) {
+   uint64_t hash = hash_key(key);
+   uint8_t tag = hash & 0x7F;
+   size_t group = (hash >> 7) & (h->nb_groups - 1);
+   for(size_t i = 1; ; i++) {
+      uint8_t *ctrl = &h->ctrl[group * HASHTABLE_GROUP];
+      unsigned match = group_match(ctrl, tag);
+      while(match) {
+         size_t slot = group * HASHTABLE_GROUP + __builtin_ctz(match);
+         if(h->keys[slot] == key)
+            return slot;
+         match &= match - 1;
+      }
+      if(group_match(ctrl, HASHTABLE_EMPTY))
+         return -1;
+      group = (group + i) & (h->nb_groups - 1); // triangular probing visits all the groups
+   }
+}
+
+struct index_entry *hashtable_lookup(hashtable_t *h, uint64_t key) {
+   ssize_t slot = find_slot(h, key);
+   return (slot < 0)?NULL:&h->entries[slot];
+}
+
+/* First empty or deleted slot on the probe sequence of a hash */
+static size_t find_free_slot(struct hashtable *h, uint64_t hash) {
+   size_t group = (hash >> 7) & (h->nb_groups - 1);
+   for(size_t i = 1; ; i++) {
+      unsigned free_slots = group_match_free(&h->ctrl[group * HASHTABLE_GROUP]);
+      if(free_slots)
+         return group * HASHTABLE_GROUP + __builtin_ctz(free_slots);
+      group = (group + i) & (h->nb_groups - 1);
+   }
+}
+
+static void insert_new_key(struct hashtable *h, uint64_t key, struct index_entry *e) {
+   uint64_t hash = hash_key(key);
+   size_t slot = find_free_slot(h, hash);
+   if(h->ctrl[slot] == HASHTABLE_DELETED)
+      h->nb_deleted--;
+   h->ctrl[slot] = hash & 0x7F;
+   h->keys[slot] = key;
+   h->entries[slot] = *e;
+   h->nb_entries++;
+}
+
+/*
+ * Get rid of the tombstones by rehashing the keys in place.
+ * Tombstones become empty slots and keys are marked deleted, i.e., "to be rehashed". Then every key to be rehashed either stays in its slot
+ * (its slot is in the first group of its probe sequence that has a free slot), moves to an empty slot, or is swapped with another key to be
+ * rehashed, which is processed next.
+ */
+static void rehash_in_place(struct hashtable *h) {
+   size_t nb_slots = h->nb_groups * HASHTABLE_GROUP;
+   for(size_t i = 0; i < nb_slots; i++)
+      h->ctrl[i] = (h->ctrl[i] == HASHTABLE_EMPTY || h->ctrl[i] == HASHTABLE_DELETED)?HASHTABLE_EMPTY:HASHTABLE_DELETED;
+
+   for(size_t i = 0; i < nb_slots; i++) {
+      if(h->ctrl[i] != HASHTABLE_DELETED)
+         continue;
+      uint64_t hash = hash_key(h->keys[i]);
+      size_t slot = find_free_slot(h, hash);
+      if(slot / HASHTABLE_GROUP == i / HASHTABLE_GROUP) { // already in the right group
+         h->ctrl[i] = hash & 0x7F;
+         continue;
+      }
+      uint64_t key = h->keys[i];
+      struct index_entry entry = h->entries[i];
+      if(h->ctrl[slot] == HASHTABLE_EMPTY) {
+         h->ctrl[i] = HASHTABLE_EMPTY;
+      } else { // swap with the key to be rehashed, and rehash it now
+         h->keys[i] = h->keys[slot];
+         h->entries[i] = h->entries[slot];
+         i--;
+      }
+      h->ctrl[slot] = hash & 0x7F;
+      h->keys[slot] = key;
+      h->entries[slot] = entry;
+   }
+   h->nb_deleted = 0;
+}
+
+void hashtable_insert(hashtable_t *h, uint64_t key, struct index_entry *e) {
+   ssize_t slot = find_slot(h, key);
+   if(slot >= 0) {
+      h->entries[slot] = *e;
+      return;
+   }
+   if(h->nb_entries >= h->nb_groups * HASHTABLE_GROUP * 7 / 8) {
+      fprintf(stderr, "Hash table is full (%lu entries)\n", h->nb_entries);
+      exit(-1);
+   }
+   insert_new_key(h, key, e);
+}
+
+int hashtable_delete(hashtable_t *h, uint64_t key) {
+   ssize_t slot = find_slot(h, key);
+   if(slot < 0)
+      return 0;
+
+   uint8_t *ctrl = &h->ctrl[slot / HASHTABLE_GROUP * HASHTABLE_GROUP];
+   if(group_match(ctrl, HASHTABLE_EMPTY)) {
+      h->ctrl[slot] = HASHTABLE_EMPTY;
+   } else {
+      h->ctrl[slot] = HASHTABLE_DELETED;
+      h->nb_deleted++;
+   }
+   h->nb_entries--;
+
+   if(h->nb_deleted > h->nb_groups * HASHTABLE_GROUP / 4)
+      rehash_in_place(h);
+   return 1;
+}
@@ -0,0 +1,16 @@
+#ifndef HASHTABLE_H
+#define HASHTABLE_H 1
+
+#include <stdint.h>
+#include <stddef.h>
+#include "memory-item.h"
+
+typedef struct hashtable hashtable_t;
+
+hashtable_t *hashtable_create(size_t max_entries);
+struct index_entry *hashtable_lookup(hashtable_t *h, uint64_t key);
+void hashtable_insert(hashtable_t *h, uint64_t key, struct index_entry *e);
+int hashtable_delete(hashtable_t *h, uint64_t key);
+size_t hashtable_memory(hashtable_t *h);
+
+#endif
@@ -0,0 +1,101 @@
+#include "headers.h"
+#include "ioengine-backend.h"
+
+/*
+ * Linux AIO backend.
+ * Completions are read directly from the completion ring mapped in user space when the caller does not want to wait (no syscall).
+ */
+
+/*
+ * Async API definition
+ */
+static int io_setup(unsigned nr, aio_context_t *ctxp) {
+	return syscall(__NR_io_setup, nr, ctxp);
+}
+
+static int io_submit(aio_context_t ctx, long nr, struct iocb **iocbpp) {
+	return syscall(__NR_io_submit, ctx, nr, iocbpp);
+}
+
+static int io_destroy(aio_context_t ctx) {
+	return syscall(__NR_io_destroy, ctx);
+}
+
+static int io_getevents(aio_context_t ctx, long min_nr, long max_nr,
+		struct io_event *events, struct timespec *timeout) {
+	return syscall(__NR_io_getevents, ctx, min_nr, max_nr, events, timeout);
+}
+
+/* The aio_context_t is the address of the completion ring, mapped in user space */
+#define AIO_RING_MAGIC 0xa10a10a1
+struct aio_ring {
+   unsigned id;
+   unsigned nr;
+   unsigned head;
+   unsigned tail;
+   unsigned magic;
+   unsigned compat_features;
+   unsigned incompat_features;
+   unsigned header_length;
+   struct io_event io_events[0];
+};
+
+static void aio_init(struct io_backend_ctx *b, unsigned flags, char *buffers, size_t buffers_size) {
+   aio_context_t *ctx = calloc(1, sizeof(*ctx));
+   if(io_setup(b->max_pending_io, ctx) < 0)
+      perr("Cannot create aio setup\n");
+   b->data = ctx;
+}
+
+static int aio_submit(struct io_backend_ctx *b, size_t nr, struct iocb **iocbs) {
+   aio_context_t *ctx = b->data;
+   b->nb_syscalls++;
+   return io_submit(*ctx, nr, iocbs);
+}
+
+/*
+ * Get the completions that are already in the AIO ring without doing a syscall
+ */
+static int aio_user_getevents(struct io_backend_ctx *b, size_t max_nr, struct io_event *events) {
+   aio_context_t *ctx = b->data;
+   struct aio_ring *ring = (void*)*ctx;
+   if(ring->magic != AIO_RING_MAGIC || ring->incompat_features) { // Unknown ring format, ask the kernel
+      struct timespec no_wait = { 0, 0 };
+      b->nb_syscalls++;
+      return io_getevents(*ctx, 0, max_nr, events, &no_wait);
+   }
+
+   size_t nr = 0;
+   unsigned head = ring->head;
+   unsigned tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+   while(head != tail && nr < max_nr) {
+      events[nr] = ring->io_events[head];
+      head = (head + 1) % ring->nr;
+      nr++;
+   }
+   __atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+   return nr;
+}
+
+static int aio_getevents(struct io_backend_ctx *b, size_t min_nr, size_t max_nr, struct io_event *events) {
+   aio_context_t *ctx = b->data;
+   if(min_nr == 0)
+      return aio_user_getevents(b, max_nr, events);
+   b->nb_syscalls++;
+   return io_getevents(*ctx, min_nr, max_nr, events, NULL);
+}
+
+static void aio_destroy(struct io_backend_ctx *b) {
+   aio_context_t *ctx = b->data;
+   io_destroy(*ctx);
+   free(ctx);
+}
+
+struct io_backend aio_backend = {
+   .name = "aio",
+   .init = aio_init,
+   .register_file = NULL,
+   .submit = aio_submit,
+   .getevents = aio_getevents,
+   .destroy = aio_destroy,
+};
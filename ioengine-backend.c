@@ -0,0 +1,91 @@
+#include "headers.h"
+#include "ioengine-backend.h"
+
+/*
+ * IO backends.
+ *
+ * The IO engine (ioengine.c) prepares IOs as Linux AIO iocbs (IOCB_CMD_PREAD / PWRITE, or PREADV / PWRITEV for merged IOs) and gets their
+ * completions as io_events. A backend sends these IOs to the kernel:
+ *   submit(nr, iocbs) sends the IOs and returns the number of IOs that have been submitted (or a negative error),
+ *   getevents(min_nr, max_nr, events) returns between min_nr and max_nr completions; event.obj is the iocb and event.res the number of bytes
+ *   transferred (or -errno). getevents must not block when min_nr is 0.
+ *
+ * Backends (chosen at startup, see set_io_engine):
+ *   - aio: Linux AIO (io_submit / io_getevents), see ioengine-aio.c
+ *   - uring: io_uring, optionally with submission and/or completion polling, see ioengine-uring.c
+ *   - threads: synchronous pread / pwrite done by a pool of helper threads, for file systems on which AIO is not really asynchronous (e.g.,
+ *     AIO blocks in io_submit when the file system does not support O_DIRECT), see ioengine-threads.c
+ *
+ * Backends are also used directly by the IO microbenchmark (microbench.c).
+ */
+struct io_engine {
+   const char *name;
+   struct io_backend *backend;
+   unsigned flags;
+};
+
+static struct io_engine io_engines[] = {
+   // The first entries are indexed by IO_ENGINE
+   { "aio", &aio_backend, 0 },
+   { "uring", &uring_backend, 0 },
+   { "threads", &threads_backend, 0 },
+   { "uring-sqpoll", &uring_backend, IORING_SETUP_SQPOLL },
+   { "uring-iopoll", &uring_backend, IORING_SETUP_IOPOLL },
+   { "uring-poll", &uring_backend, IORING_SETUP_SQPOLL | IORING_SETUP_IOPOLL },
+};
+
+static struct io_engine *io_engine = &io_engines[IO_ENGINE];
+
+static struct io_engine *find_io_engine(const char *name) {
+   for(size_t i = 0; i < sizeof(io_engines)/sizeof(*io_engines); i++)
+      if(!strcmp(io_engines[i].name, name))
+         return &io_engines[i];
+   die("Unknown IO engine %s (valid engines: aio, uring, uring-sqpoll, uring-iopoll, uring-poll, threads)\n", name);
+}
+
+void set_io_engine(const char *name) {
+   io_engine = find_io_engine(name);
+}
+
+const char *get_io_engine_name(void) {
+   return io_engine->name;
+}
+
+/*
+ * Create a backend for a thread. name is the name of the engine, or NULL for the engine chosen by set_io_engine.
+ * buffers is the memory from/to which IOs will be done (it may be registered in the kernel by the backend).
+ */
+struct io_backend_ctx *io_backend_init(const char *name, size_t max_pending_io, char *buffers, size_t buffers_size) {
+   struct io_engine *engine = name?find_io_engine(name):io_engine;
+   struct io_backend_ctx *b = calloc(1, sizeof(*b));
+   b->backend = engine->backend;
+   b->max_pending_io = max_pending_io;
+   b->backend->init(b, engine->flags, buffers, buffers_size);
+   return b;
+}
+
+void io_backend_register_file(struct io_backend_ctx *b, int fd) {
+   if(b->backend->register_file)
+      b->backend->register_file(b, fd);
+}
+
+int io_backend_submit(struct io_backend_ctx *b, size_t nr, struct iocb **iocbs) {
+   return b->backend->submit(b, nr, iocbs);
+}
+
+int io_backend_getevents(struct io_backend_ctx *b, size_t min_nr, size_t max_nr, struct io_event *events) {
+   return b->backend->getevents(b, min_nr, max_nr, events);
+}
+
+/* Free a backend, all its IOs must have completed */
+void io_backend_destroy(struct io_backend_ctx *b) {
+   b->backend->destroy(b);
+   free(b);
+}
+
+/* Number of IO syscalls done since the last call */
+size_t io_backend_syscalls(struct io_backend_ctx *b) {
+   size_t nb_syscalls = b->nb_syscalls;
+   b->nb_syscalls = 0;
+   return nb_syscalls;
+}
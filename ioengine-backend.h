@@ -0,0 +1,30 @@
+#ifndef IOENGINE_BACKEND_H
+#define IOENGINE_BACKEND_H 1
+
+/*
+ * Kernel interfaces used by the IO engine to do the IOs (see ioengine-backend.c).
+ * Only included by the IO engine and its backends, other files use the io_backend_* functions of ioengine.h.
+ */
+struct io_backend_ctx;
+
+struct io_backend {
+   const char *name;
+   void (*init)(struct io_backend_ctx *b, unsigned flags, char *buffers, size_t buffers_size);
+   void (*register_file)(struct io_backend_ctx *b, int fd); // NULL if the backend does not need to know the files in advance
+   int (*submit)(struct io_backend_ctx *b, size_t nr, struct iocb **iocbs);
+   int (*getevents)(struct io_backend_ctx *b, size_t min_nr, size_t max_nr, struct io_event *events);
+   void (*destroy)(struct io_backend_ctx *b);   // Release the kernel resources, no IO may be in flight
+};
+
+struct io_backend_ctx {
+   struct io_backend *backend;
+   size_t max_pending_io;           // The caller never has more IOs in flight
+   size_t nb_syscalls;              // For stats, IO syscalls done by the caller
+   void *data;                      // Private state of the backend
+};
+
+extern struct io_backend aio_backend;
+extern struct io_backend uring_backend;
+extern struct io_backend threads_backend;
+
+#endif
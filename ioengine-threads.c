@@ -0,0 +1,150 @@
+#include "headers.h"
+#include "ioengine-backend.h"
+#include <sys/uio.h>
+#include <errno.h>
+
+/*
+ * Thread pool backend: IOs are done with synchronous pread / pwrite (preadv / pwritev for merged IOs) by IO_THREADS_PER_WORKER helper threads.
+ * Useful when the file system does not support asynchronous O_DIRECT IOs (AIO silently becomes synchronous and io_submit blocks the worker).
+ *
+ * Submitted IOs are pushed in a ring that the helpers consume, and helpers push the completions in a second ring that is consumed by getevents.
+ * Both rings are protected by the same lock. The caller never has more than max_pending_io IOs in flight, so the rings cannot overflow.
+ */
+struct io_threads {
+   pthread_mutex_t lock;
+   pthread_cond_t submitted_cond;      // Signaled when IOs are submitted
+   pthread_cond_t completed_cond;      // Signaled when an IO completes
+   struct iocb **submitted;            // Ring of IOs waiting for a helper
+   size_t submitted_head, submitted_tail;
+   struct io_event *completed;         // Ring of completions waiting for getevents
+   size_t completed_head, completed_tail;
+   size_t max_pending_io;
+   int stop;                           // Set by threads_destroy, helpers exit once the submitted ring is empty
+   pthread_t helpers[IO_THREADS_PER_WORKER];
+};
+
+static long do_sync_io(struct iocb *iocb) {
+   ssize_t ret;
+   switch(iocb->aio_lio_opcode) {
+      case IOCB_CMD_PREAD:
+         ret = pread(iocb->aio_fildes, (void*)iocb->aio_buf, iocb->aio_nbytes, iocb->aio_offset);
+         break;
+      case IOCB_CMD_PWRITE:
+         ret = pwrite(iocb->aio_fildes, (void*)iocb->aio_buf, iocb->aio_nbytes, iocb->aio_offset);
+         break;
+      case IOCB_CMD_PREADV:
+         ret = preadv(iocb->aio_fildes, (struct iovec*)iocb->aio_buf, iocb->aio_nbytes, iocb->aio_offset);
+         break;
+      case IOCB_CMD_PWRITEV:
+         ret = pwritev(iocb->aio_fildes, (struct iovec*)iocb->aio_buf, iocb->aio_nbytes, iocb->aio_offset);
+         break;
+      default:
+         die("Unknown IO opcode %d\n", iocb->aio_lio_opcode);
+   }
+   return (ret < 0)?-errno:ret;
+}
+
+static void *io_helper(void *pdata) {
+   struct io_threads *t = pdata;
+   while(1) {
+      pthread_mutex_lock(&t->lock);
+      while(t->submitted_head == t->submitted_tail && !t->stop)
+         pthread_cond_wait(&t->submitted_cond, &t->lock);
+      if(t->submitted_head == t->submitted_tail) {
+         pthread_mutex_unlock(&t->lock);
+         break;
+      }
+      struct iocb *iocb = t->submitted[t->submitted_head % t->max_pending_io];
+      t->submitted_head++;
+      pthread_mutex_unlock(&t->lock);
+
+      long res = do_sync_io(iocb);
+
+      pthread_mutex_lock(&t->lock);
+      struct io_event *event = &t->completed[t->completed_tail % t->max_pending_io];
+      event->data = 0;
+      event->obj = (uint64_t)iocb;
+      event->res = res;
+      event->res2 = 0;
+      __atomic_store_n(&t->completed_tail, t->completed_tail + 1, __ATOMIC_RELEASE);
+      pthread_cond_signal(&t->completed_cond);
+      pthread_mutex_unlock(&t->lock);
+   }
+   return NULL;
+}
+
+static void threads_init(struct io_backend_ctx *b, unsigned flags, char *buffers, size_t buffers_size) {
+   struct io_threads *t = calloc(1, sizeof(*t));
+   pthread_mutex_init(&t->lock, NULL);
+   pthread_cond_init(&t->submitted_cond, NULL);
+   pthread_cond_init(&t->completed_cond, NULL);
+   t->max_pending_io = b->max_pending_io;
+   t->submitted = calloc(t->max_pending_io, sizeof(*t->submitted));
+   t->completed = calloc(t->max_pending_io, sizeof(*t->completed));
+   b->data = t;
+
+   for(size_t i = 0; i < IO_THREADS_PER_WORKER; i++) {
+      if(pthread_create(&t->helpers[i], NULL, io_helper, t))
+         perr("Cannot create IO helper thread\n");
+   }
+}
+
+static int threads_submit(struct io_backend_ctx *b, size_t nr, struct iocb **iocbs) {
+   struct io_threads *t = b->data;
+   pthread_mutex_lock(&t->lock);
+   for(size_t i = 0; i < nr; i++) {
+      t->submitted[t->submitted_tail % t->max_pending_io] = iocbs[i];
+      t->submitted_tail++;
+   }
+   if(nr == 1)
+      pthread_cond_signal(&t->submitted_cond);
+   else
+      pthread_cond_broadcast(&t->submitted_cond);
+   pthread_mutex_unlock(&t->lock);
+   return nr;
+}
+
+static int threads_getevents(struct io_backend_ctx *b, size_t min_nr, size_t max_nr, struct io_event *events) {
+   struct io_threads *t = b->data;
+   if(min_nr == 0 && __atomic_load_n(&t->completed_tail, __ATOMIC_ACQUIRE) == t->completed_head)
+      return 0; // nothing completed, don't take the lock
+
+   size_t nr = 0;
+   pthread_mutex_lock(&t->lock);
+   while(t->completed_tail - t->completed_head < min_nr)
+      pthread_cond_wait(&t->completed_cond, &t->lock);
+   while(t->completed_head != t->completed_tail && nr < max_nr) {
+      events[nr] = t->completed[t->completed_head % t->max_pending_io];
+      t->completed_head++;
+      nr++;
+   }
+   pthread_mutex_unlock(&t->lock);
+   return nr;
+}
+
+/* Stop and join the helper threads */
+static void threads_destroy(struct io_backend_ctx *b) {
+   struct io_threads *t = b->data;
+   pthread_mutex_lock(&t->lock);
+   t->stop = 1;
+   pthread_cond_broadcast(&t->submitted_cond);
+   pthread_mutex_unlock(&t->lock);
+   for(size_t i = 0; i < IO_THREADS_PER_WORKER; i++)
+      pthread_join(t->helpers[i], NULL);
+
+   pthread_cond_destroy(&t->completed_cond);
+   pthread_cond_destroy(&t->submitted_cond);
+   pthread_mutex_destroy(&t->lock);
+   free(t->completed);
+   free(t->submitted);
+   free(t);
+}
+
+struct io_backend threads_backend = {
+   .name = "threads",
+   .init = threads_init,
+   .register_file = NULL,
+   .submit = threads_submit,
+   .getevents = threads_getevents,
+   .destroy = threads_destroy,
+};
@@ -0,0 +1,263 @@
+#include "headers.h"
+#include "ioengine-backend.h"
+
+/*
+ * io_uring backend.
+ * The page cache is registered as fixed buffers and the slab files are registered as fixed files.
+ * io_uring can also poll for submissions (SQPOLL: a kernel thread consumes the submission ring) and for completions (IOPOLL: completions are
+ * polled from the device instead of waiting for interrupts, only works with devices that have poll queues). With both, a worker does no syscall.
+ */
+
+/*
+ * io_uring API definition
+ */
+static int io_uring_setup(unsigned entries, struct io_uring_params *p) {
+   return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+   return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int io_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args) {
+   return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+#define URING_REGISTERED_BUFFER_SIZE (1024LU*1024LU*1024LU) // The kernel refuses to register buffers bigger than 1GB, so the page cache is registered 1GB by 1GB
+#define URING_MAX_REGISTERED_FILES 1024                      // Files with a bigger fd number are not registered
+#define URING_SQPOLL_IDLE_MS 1000                            // The SQPOLL kernel thread goes to sleep after 1s without submission
+struct uring {
+   int fd;
+   unsigned flags;                  // IORING_SETUP_SQPOLL / IORING_SETUP_IOPOLL
+   unsigned *sq_head, *sq_tail, *sq_mask, *sq_array, *sq_flags;
+   unsigned sq_entries;
+   char *sq_ring, *cq_ring;         // Mapped rings, unmapped by uring_destroy
+   size_t sq_ring_size, cq_ring_size;
+   unsigned *cq_head, *cq_tail, *cq_mask;
+   struct io_uring_sqe *sqes;
+   struct io_uring_cqe *cqes;
+
+   char *registered_buffers;        // start of the page cache, NULL if buffers could not be registered
+   size_t registered_buffers_size;
+   int *fixed_files;                // fd -> index in the registered files, -1 if not registered
+   int nb_fixed_files;
+};
+
+/*
+ * io_uring submission and completion.
+ * Requests are prepared as iocbs by read_page_async / write_page_async and translated into SQEs here.
+ * The user_data of a SQE is the iocb, so that completions can be translated back into io_events.
+ */
+static int uring_submit(struct io_backend_ctx *b, size_t nr, struct iocb **iocbs) {
+   struct uring *u = b->data;
+   unsigned tail = *u->sq_tail;
+   unsigned mask = *u->sq_mask;
+   size_t i;
+
+   for(i = 0; i < nr; i++) {
+      if(tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE) >= u->sq_entries)
+         break; // submission ring is full (the SQPOLL thread has not consumed the previous SQEs yet), the caller submits the rest later
+
+      struct iocb *iocb = iocbs[i];
+      unsigned idx = tail & mask;
+      struct io_uring_sqe *sqe = &u->sqes[idx];
+      char *buf = (char*)iocb->aio_buf;
+      int write = (iocb->aio_lio_opcode == IOCB_CMD_PWRITE || iocb->aio_lio_opcode == IOCB_CMD_PWRITEV);
+      int vectored = (iocb->aio_lio_opcode == IOCB_CMD_PREADV || iocb->aio_lio_opcode == IOCB_CMD_PWRITEV);
+
+      memset(sqe, 0, sizeof(*sqe));
+      if(vectored) { // merged IO, aio_buf is an array of aio_nbytes iovecs
+         sqe->opcode = write?IORING_OP_WRITEV:IORING_OP_READV;
+      } else if(u->registered_buffers && buf >= u->registered_buffers && buf + iocb->aio_nbytes <= u->registered_buffers + u->registered_buffers_size) {
+         sqe->opcode = write?IORING_OP_WRITE_FIXED:IORING_OP_READ_FIXED;
+         sqe->buf_index = (buf - u->registered_buffers) / URING_REGISTERED_BUFFER_SIZE;
+      } else {
+         sqe->opcode = write?IORING_OP_WRITE:IORING_OP_READ;
+      }
+      if(iocb->aio_fildes < URING_MAX_REGISTERED_FILES && u->fixed_files[iocb->aio_fildes] != -1) {
+         sqe->fd = u->fixed_files[iocb->aio_fildes];
+         sqe->flags = IOSQE_FIXED_FILE;
+      } else {
+         sqe->fd = iocb->aio_fildes;
+      }
+      sqe->addr = iocb->aio_buf;
+      sqe->len = iocb->aio_nbytes;
+      sqe->off = iocb->aio_offset;
+      sqe->user_data = (uint64_t)iocb;
+
+      u->sq_array[idx] = idx;
+      tail++;
+   }
+   __atomic_store_n(u->sq_tail, tail, __ATOMIC_RELEASE);
+
+   if(u->flags & IORING_SETUP_SQPOLL) {
+      // The kernel thread picks up the requests by itself, unless it fell asleep
+      __sync_synchronize();
+      if(__atomic_load_n(u->sq_flags, __ATOMIC_ACQUIRE) & IORING_SQ_NEED_WAKEUP) {
+         b->nb_syscalls++;
+         io_uring_enter(u->fd, 0, 0, IORING_ENTER_SQ_WAKEUP);
+      }
+      return i;
+   }
+
+   b->nb_syscalls++;
+   int ret = io_uring_enter(u->fd, i, 0, 0);
+   // The kernel may consume fewer SQEs than requested (EAGAIN / EBUSY). The SQEs it left in the ring are withdrawn and the caller submits them
+   // again later. Without SQPOLL, the kernel only reads the ring during io_uring_enter, so the tail can safely be moved back to the head.
+   __atomic_store_n(u->sq_tail, __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+   return ret;
+}
+
+static int uring_getevents(struct io_backend_ctx *b, size_t min_nr, size_t max_nr, struct io_event *events) {
+   struct uring *u = b->data;
+   size_t nr = 0;
+   int polled = 0;
+
+   while(1) {
+      unsigned head = *u->cq_head;
+      unsigned tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+      for(; head != tail && nr < max_nr; head++, nr++) {
+         struct io_uring_cqe *cqe = &u->cqes[head & *u->cq_mask];
+         events[nr].data = 0;
+         events[nr].obj = cqe->user_data;
+         events[nr].res = cqe->res;
+         events[nr].res2 = 0;
+      }
+      __atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+
+      if(nr >= min_nr) {
+         if(nr || polled || !(u->flags & IORING_SETUP_IOPOLL) || (u->flags & IORING_SETUP_SQPOLL))
+            break;
+         // IOPOLL without the kernel thread: completions only appear when we poll for them
+         b->nb_syscalls++;
+         io_uring_enter(u->fd, 0, 0, IORING_ENTER_GETEVENTS);
+         polled = 1;
+         continue;
+      }
+
+      {
+         if(u->flags & IORING_SETUP_SQPOLL) {
+            // Completions are posted without our help (and polled by the kernel thread in IOPOLL mode), just spin...
+            if(!(__atomic_load_n(u->sq_flags, __ATOMIC_ACQUIRE) & IORING_SQ_NEED_WAKEUP)) {
+               if(!PINNING)
+                  usleep(2);
+               else
+                  NOP10();
+               continue;
+            }
+            // ... unless the kernel thread fell asleep
+            b->nb_syscalls++;
+            if(io_uring_enter(u->fd, 0, min_nr - nr, IORING_ENTER_GETEVENTS | IORING_ENTER_SQ_WAKEUP) < 0)
+               perr("io_uring_enter failed while waiting for %lu completions\n", min_nr - nr);
+            continue;
+         }
+         b->nb_syscalls++;
+         if(io_uring_enter(u->fd, 0, min_nr - nr, IORING_ENTER_GETEVENTS) < 0)
+            perr("io_uring_enter failed while waiting for %lu completions\n", min_nr - nr);
+      }
+   }
+   return nr;
+}
+
+static void uring_init(struct io_backend_ctx *b, unsigned flags, char *buffers, size_t buffers_size) {
+   struct uring *u = calloc(1, sizeof(*u));
+   b->data = u;
+   struct io_uring_params params;
+   memset(&params, 0, sizeof(params));
+   params.flags = flags;
+   params.sq_thread_idle = URING_SQPOLL_IDLE_MS;
+
+   u->fd = io_uring_setup(b->max_pending_io, &params);
+   if(u->fd < 0)
+      perr("Cannot create io_uring setup (SQPOLL needs CAP_SYS_NICE on kernels < 5.11)\n");
+   u->flags = flags;
+   u->sq_entries = params.sq_entries;
+
+   size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+   size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+   char *sq = mmap(NULL, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+   char *cq = mmap(NULL, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_CQ_RING);
+   u->sq_ring = sq;
+   u->sq_ring_size = sq_size;
+   u->cq_ring = cq;
+   u->cq_ring_size = cq_size;
+   u->sqes = mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+   if(sq == MAP_FAILED || cq == MAP_FAILED || u->sqes == MAP_FAILED)
+      perr("Cannot map io_uring rings\n");
+
+   u->sq_head = (void*)&sq[params.sq_off.head];
+   u->sq_tail = (void*)&sq[params.sq_off.tail];
+   u->sq_mask = (void*)&sq[params.sq_off.ring_mask];
+   u->sq_array = (void*)&sq[params.sq_off.array];
+   u->sq_flags = (void*)&sq[params.sq_off.flags];
+   u->cq_head = (void*)&cq[params.cq_off.head];
+   u->cq_tail = (void*)&cq[params.cq_off.tail];
+   u->cq_mask = (void*)&cq[params.cq_off.ring_mask];
+   u->cqes = (void*)&cq[params.cq_off.cqes];
+
+   /* Register the buffers (the page cache), all IOs are done from/to them */
+   size_t nb_buffers = (buffers_size + URING_REGISTERED_BUFFER_SIZE - 1) / URING_REGISTERED_BUFFER_SIZE;
+   struct iovec *iov = calloc(nb_buffers, sizeof(*iov));
+   for(size_t i = 0; i < nb_buffers; i++) {
+      iov[i].iov_base = &buffers[i*URING_REGISTERED_BUFFER_SIZE];
+      iov[i].iov_len = (i == nb_buffers - 1)?(buffers_size - i*URING_REGISTERED_BUFFER_SIZE):URING_REGISTERED_BUFFER_SIZE;
+   }
+   if(!nb_buffers) {
+      u->registered_buffers = NULL; // shared page cache, using non fixed buffers
+   } else if(io_uring_register(u->fd, IORING_REGISTER_BUFFERS, iov, nb_buffers) == 0) {
+      u->registered_buffers = buffers;
+      u->registered_buffers_size = buffers_size;
+   } else {
+      printf("#WARNING! Cannot register the page cache as io_uring buffers (check ulimit -l), using non fixed buffers\n");
+   }
+   free(iov);
+
+   /* Reserve a sparse table of fixed files, slab files are added when they are opened (uring_register_file) */
+   int *files = malloc(URING_MAX_REGISTERED_FILES * sizeof(*files));
+   u->fixed_files = malloc(URING_MAX_REGISTERED_FILES * sizeof(*u->fixed_files));
+   for(size_t i = 0; i < URING_MAX_REGISTERED_FILES; i++) {
+      files[i] = -1;
+      u->fixed_files[i] = -1;
+   }
+   if(io_uring_register(u->fd, IORING_REGISTER_FILES, files, URING_MAX_REGISTERED_FILES) == 0)
+      u->nb_fixed_files = 0;
+   else
+      u->nb_fixed_files = -1; // fixed files not supported
+   free(files);
+}
+
+/* Register a file that will be accessed by the worker */
+static void uring_register_file(struct io_backend_ctx *b, int fd) {
+   struct uring *u = b->data;
+   if(u->nb_fixed_files < 0 || fd >= URING_MAX_REGISTERED_FILES || u->nb_fixed_files >= URING_MAX_REGISTERED_FILES)
+      return;
+
+   struct io_uring_files_update update = {
+      .offset = u->nb_fixed_files,
+      .fds = (uint64_t)&fd,
+   };
+   if(io_uring_register(u->fd, IORING_REGISTER_FILES_UPDATE, &update, 1) != 1)
+      return; // keep using the fd directly
+   u->fixed_files[fd] = u->nb_fixed_files;
+   u->nb_fixed_files++;
+}
+
+/* Unmap the rings and close the ring fd (the kernel unregisters the buffers and the files) */
+static void uring_destroy(struct io_backend_ctx *b) {
+   struct uring *u = b->data;
+   munmap(u->sqes, u->sq_entries * sizeof(struct io_uring_sqe));
+   munmap(u->cq_ring, u->cq_ring_size);
+   munmap(u->sq_ring, u->sq_ring_size);
+   close(u->fd);
+   free(u->fixed_files);
+   free(u);
+}
+
+struct io_backend uring_backend = {
+   .name = "uring",
+   .init = uring_init,
+   .register_file = uring_register_file,
+   .submit = uring_submit,
+   .getevents = uring_getevents,
+   .destroy = uring_destroy,
+};
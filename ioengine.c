@@ -1,4 +1,6 @@
 #include "headers.h"
+#include "ioengine-backend.h"
+#include <errno.h>
 
 /*
  * Asynchronous IO engine.
@@ -15,10 +17,37 @@
  *          cb->lru_entry->page // the page that contains the data
  *      }
  *
+ * Items bigger than a page are read and written with a single IO of slab->page_size bytes, in the page cache of their slab.
+ *
  * Writing a page consists in flushing the content of the page cache to disk.
  * It means the page must be in memory, it is not possible to write a non cached page.
  * This could be easilly changed if need be.
  *
+ * IOs are prepared as Linux AIO iocbs and sent to the kernel by a backend chosen at startup (see set_io_engine and ioengine-backend.c):
+ * Linux AIO, io_uring (optionally polled), or a pool of helper threads doing synchronous pread / pwrite.
+ *
+ * By default a worker waits for all the IOs it submitted before processing the completions (and dequeuing new requests).
+ * With PARTIAL_IO_COMPLETIONS, the worker only processes the IOs that have completed (peeking the completion rings without syscall) and keeps
+ * dequeuing and submitting new requests while the other IOs are in flight. IO slots are then freed out of order, and a page that is written
+ * while a previous write of the same page is still in flight is only written again once the previous write has completed.
+ *
+ * With MERGE_ADJACENT_IOS, requests of a submission batch that target consecutive pages of the same file are sent as one vectored IO
+ * (preadv / pwritev, the pages are not contiguous in the page cache). The first iocb of the run becomes the vectored request and the other
+ * iocbs are chained to it (merged_next), completions are then fanned out to the callback of every page.
+ *
+ * Reads and writes wait in separate queues before being submitted. The IO_SCHEDULER policy decides how many queued writes are submitted
+ * together with the queued reads (all of them, none until no read is waiting, a share of the batch, or a fixed budget per batch).
+ * Reads are then submitted first, so that they are not delayed by bursts of writes.
+ *
+ * Workers stop dequeuing requests when io_queue_depth() IOs are pending (NEVER_EXCEED_QUEUE_DEPTH). With ADAPTIVE_QUEUE_DEPTH, this depth is
+ * adjusted every ADAPTIVE_QD_PERIOD_US from the latency and throughput of the IOs completed during the period (adjust_queue_depth).
+ *
+ * With WRITE_BACK_CACHE, writing a page only marks it as dirty (lru_entry->dirty_since) and remembers it in a FIFO of pages to flush.
+ * Following writes of the page are absorbed until the page is flushed, i.e., after WRITE_BACK_DELAY_US or when the worker has too many dirty pages
+ * (worker_ioengine_flush_dirty_pages). Callbacks are called immediately (ACK_ON_CACHE) or once the flush has completed (ACK_ON_DISK).
+ * Dirty pages are not evicted from the page cache, so when half of a page cache is dirty new writes are written through.
+ * Dirty pages that have not been flushed are lost if the process stops.
+ *
  * ASSUMPTIONS:
  *   The page cache is big enough to hold as many pages as concurrent buffered IOs.
  */
@@ -27,49 +56,72 @@
  * Non asynchronous calls to ease some things
  */
 static __thread char *disk_data;
-void *safe_pread(int fd, off_t offset) {
-   if(!disk_data)
-      disk_data = aligned_alloc(PAGE_SIZE, PAGE_SIZE);
-   int r = pread(fd, disk_data, PAGE_SIZE, offset);
-   if(r != PAGE_SIZE)
-      perr("pread failed! Read %d instead of %lu (offset %lu)\n", r, PAGE_SIZE, offset);
+static __thread size_t disk_data_size;
+void *safe_pread(int fd, off_t offset, size_t size) {
+   if(disk_data_size < size) {
+      free(disk_data);
+      disk_data = aligned_alloc(PAGE_SIZE, size);
+      disk_data_size = size;
+   }
+   int r = pread(fd, disk_data, size, offset);
+   if(r != size)
+      perr("pread failed! Read %d instead of %lu (offset %lu)\n", r, size, offset);
    return disk_data;
 }
 
 /*
- * Async API definition
+ * Definition of the context of an IO worker thread
  */
-static int io_setup(unsigned nr, aio_context_t *ctxp) {
-	return syscall(__NR_io_setup, nr, ctxp);
-}
-
-static int io_submit(aio_context_t ctx, long nr, struct iocb **iocbpp) {
-	return syscall(__NR_io_submit, ctx, nr, iocbpp);
-}
-
-static int io_getevents(aio_context_t ctx, long min_nr, long max_nr,
-		struct io_event *events, struct timespec *timeout) {
-	return syscall(__NR_io_getevents, ctx, min_nr, max_nr, events, timeout);
-}
+#define READ_QUEUE 0
+#define WRITE_QUEUE 1
+struct io_queue {
+   struct iocb **iocbs;                // IOs waiting to be submitted, in order of arrival (ring of max_pending_io IOs)
+   size_t queued, submitted;
+   uint64_t queueing_time;             // For stats, cycles spent in the queue by the submitted IOs
+   size_t nb_submitted;
+};
 
+struct queue_depth_controller {
+   size_t queue_depth;                 // Maximum number of pending IOs
+   int direction;                      // +1 or -1, current direction of the search of the best depth
+   uint64_t period_start;
+   uint64_t latency;                   // Sum of the latency (cycles) of the IOs completed during the period
+   size_t nb_ios, nb_pages;            // IOs (and pages) completed during the period
+   size_t in_flight, nb_submits;       // To compute the average number of IOs in flight when submitting
+   size_t last_latency, last_throughput; // us and pages/s of the last period, for stats and to detect that a change of depth decreased throughput
+};
 
-/*
- * Definition of the context of an IO worker thread
- */
 struct linked_callbacks {
    struct slab_callback *callback;
+   size_t write;                       // 0 for a read, otherwise number of the write of the page that must complete before calling the callback
    struct linked_callbacks *next;
 };
 struct io_context {
-   aio_context_t ctx __attribute__((aligned(64)));
-   volatile size_t sent_io;
-   volatile size_t processed_io;
+   struct io_backend_ctx *backend __attribute__((aligned(64)));
+   volatile size_t sent_io;            // IOs enqueued by read_page_async / write_page_async
+   volatile size_t processed_io;       // IOs completed and processed
    size_t max_pending_io;
-   size_t ios_sent_to_disk;
-   struct iocb *iocb;
-   struct iocb **iocbs;
+   size_t ios_sent_to_disk;            // IOs in flight
+   size_t nb_completed_io;             // IOs completed but not processed yet (in events)
+   char stats[256];
+   struct iocb *iocb;                  // IO slots
+   struct iocb **free_iocbs;           // Stack of unused IO slots
+   size_t nb_free_iocbs;
+   struct io_queue queues[2];          // READ_QUEUE and WRITE_QUEUE
+   uint64_t *queued_at;                // Time at which the IOs have been queued, indexed by IO slot
+   uint64_t *submitted_at;             // Time at which the IOs have been sent to the disk, indexed by IO slot
+   struct queue_depth_controller qd;
+   struct iocb **merged_next;          // Next page of a merged IO, indexed by IO slot
+   struct iovec *iovecs;               // MAX_MERGED_IOS iovecs per IO slot, used when the slot is the first page of a merged IO
+   size_t nb_merged_io;                // For stats, pages that did not need their own IO because they were merged with a neighbour
+   struct iocb **iocbs;                // Submission batch
+   size_t nb_unsubmitted_ios;          // IOs at the start of the batch that the backend did not accept yet
    struct io_event *events;
    struct linked_callbacks *linked_callbacks;
+   struct linked_callbacks *deferred_writes; // writes of pages that are already being written
+   struct linked_callbacks *dirty_pages, *dirty_pages_tail; // write-back cache: flush callbacks of the dirty pages, oldest first
+   size_t nb_dirty_pages;
+   size_t nb_absorbed_writes;          // For stats, writes of pages that were already dirty
 };
 
 /*
@@ -87,10 +139,11 @@ static void process_linked_callbacks(struct io_context *ctx) {
       while(linked_cb) {
          struct linked_callbacks *next = linked_cb->next;
          struct slab_callback *callback = linked_cb->callback;
-         if(callback->lru_entry->contains_data) {
+         struct lru *lru_entry = callback->lru_entry;
+         if(linked_cb->write?(lru_entry->completed_writes >= linked_cb->write):lru_entry->contains_data) {
             callback->io_cb(callback);
-            free(linked_cb);
-         } else { // page has not been prefetched yet, it's likely in the list of pages that will be read during the next kernel call
+            pool_free(linked_cb);
+         } else { // page has not been prefetched (or flushed) yet, it's likely in the list of pages that will be read during the next kernel call
             linked_cb->next = ctx->linked_callbacks;
             ctx->linked_callbacks = linked_cb; // re-link our callback
          }
@@ -100,22 +153,161 @@ static void process_linked_callbacks(struct io_context *ctx) {
    } stop_debug_timer(10000, "%lu linked callbacks\n", nb_linked);
 }
 
+/*
+ * Writes that were delayed because the page was already being written are retried once the previous write has completed.
+ */
+static void process_deferred_writes(struct io_context *ctx) {
+   struct linked_callbacks *deferred = ctx->deferred_writes;
+   ctx->deferred_writes = NULL;
+   while(deferred) {
+      struct linked_callbacks *next = deferred->next;
+      struct slab_callback *callback = deferred->callback;
+      pool_free(deferred);
+      write_page_async(callback); // deferred again if the page is still being written
+      deferred = next;
+   }
+}
+
+static size_t iocb_slot(struct io_context *ctx, struct iocb *iocb) {
+   return iocb - ctx->iocb;
+}
+
+/* Number of bytes read or written by an IO */
+static size_t iocb_size(struct iocb *iocb) {
+   if(iocb->aio_lio_opcode != IOCB_CMD_PREADV && iocb->aio_lio_opcode != IOCB_CMD_PWRITEV)
+      return iocb->aio_nbytes;
+
+   size_t size = 0;
+   struct iovec *iov = (void*)iocb->aio_buf;
+   for(size_t i = 0; i < iocb->aio_nbytes; i++)
+      size += iov[i].iov_len;
+   return size;
+}
+
+static void link_callback(struct linked_callbacks **list, struct slab_callback *callback, size_t write) {
+   struct linked_callbacks *linked_cb = pool_alloc(sizeof(*linked_cb));
+   linked_cb->callback = callback;
+   linked_cb->write = write;
+   linked_cb->next = *list;
+   *list = linked_cb;
+}
+
+/*
+ * Merge requests to consecutive pages of the same file into vectored IOs.
+ * The batch is sorted by file and offset (requests of a batch never target the same page, so the order does not matter).
+ * merge_adjacent_ios returns the number of IOs left in iocbs.
+ */
+
+static int iocb_cmp(const void *a, const void *b) {
+   const struct iocb *x = *(struct iocb **)a, *y = *(struct iocb **)b;
+   if(x->aio_fildes != y->aio_fildes)
+      return (x->aio_fildes < y->aio_fildes)?-1:1;
+   if(x->aio_lio_opcode != y->aio_lio_opcode)
+      return (x->aio_lio_opcode < y->aio_lio_opcode)?-1:1;
+   if(x->aio_offset != y->aio_offset)
+      return (x->aio_offset < y->aio_offset)?-1:1;
+   return 0;
+}
+
+static size_t merge_adjacent_ios(struct io_context *ctx, struct iocb **iocbs, size_t nr) {
+   size_t nb_ios = 0;
+   qsort(iocbs, nr, sizeof(*iocbs), iocb_cmp);
+   for(size_t i = 0; i < nr;) {
+      struct iocb *first = iocbs[i];
+      uint64_t end = first->aio_offset + first->aio_nbytes;
+      size_t run = 1;
+      while(i + run < nr && run < MAX_MERGED_IOS) {
+         struct iocb *next = iocbs[i + run];
+         if(next->aio_fildes != first->aio_fildes || next->aio_lio_opcode != first->aio_lio_opcode || next->aio_offset != end)
+            break;
+         end += next->aio_nbytes;
+         run++;
+      }
+
+      if(run > 1) {
+         struct iovec *iov = &ctx->iovecs[iocb_slot(ctx, first)*MAX_MERGED_IOS];
+         for(size_t j = 0; j < run; j++) {
+            struct iocb *cur = iocbs[i + j];
+            iov[j].iov_base = (void*)cur->aio_buf;
+            iov[j].iov_len = cur->aio_nbytes;
+            ctx->merged_next[iocb_slot(ctx, cur)] = (j == run - 1)?NULL:iocbs[i + j + 1];
+         }
+         first->aio_lio_opcode = (first->aio_lio_opcode == IOCB_CMD_PWRITE)?IOCB_CMD_PWRITEV:IOCB_CMD_PREADV;
+         first->aio_buf = (uint64_t)iov;
+         first->aio_nbytes = run;
+         ctx->nb_merged_io += run - 1;
+      }
+
+      iocbs[nb_ios++] = first;
+      i += run;
+   }
+   return nb_ios;
+}
+
+/*
+ * How many of the queued writes are submitted with the queued reads.
+ * Whatever the policy, all writes are submitted when they fill a quarter of the IO slots, otherwise the worker would run out of slots
+ * (it keeps dequeuing requests while writes wait).
+ */
+static size_t nb_writes_to_submit(struct io_context *ctx, size_t nb_reads, size_t nb_writes) {
+   if(!nb_reads || nb_writes >= ctx->max_pending_io / 4)
+      return nb_writes;
+
+   size_t max_writes = nb_writes;
+   switch(IO_SCHEDULER) {
+      case IO_SCHED_FIFO:
+         break;
+      case IO_SCHED_READ_PRIORITY:
+         max_writes = 0;
+         break;
+      case IO_SCHED_WEIGHTED:
+         max_writes = nb_reads * IO_SCHED_WRITE_WEIGHT / (100 - IO_SCHED_WRITE_WEIGHT);
+         if(max_writes == 0)
+            max_writes = 1;
+         break;
+      case IO_SCHED_WRITE_BUDGET:
+         max_writes = IO_SCHED_MAX_WRITES_PER_BATCH;
+         break;
+      default:
+         die("Unknown IO scheduler %d\n", IO_SCHEDULER);
+   }
+   return (nb_writes < max_writes)?nb_writes:max_writes;
+}
+
+/* Move the first nr IOs of a queue to the submission batch */
+static void dequeue_ios(struct io_context *ctx, struct io_queue *q, size_t nr, struct iocb **iocbs) {
+   uint64_t now;
+   rdtscll(now);
+   for(size_t i = 0; i < nr; i++) {
+      iocbs[i] = q->iocbs[(q->submitted + i)%ctx->max_pending_io];
+      q->queueing_time += now - ctx->queued_at[iocb_slot(ctx, iocbs[i])];
+      ctx->submitted_at[iocb_slot(ctx, iocbs[i])] = now;
+   }
+   q->submitted += nr;
+   q->nb_submitted += nr;
+}
+
 /*
  * Loop executed by worker threads
  */
 static void worker_do_io(struct io_context *ctx) {
-   size_t pending = ctx->sent_io - ctx->processed_io;
-   if(pending == 0) {
-      ctx->ios_sent_to_disk = 0;
+   struct io_queue *reads = &ctx->queues[READ_QUEUE], *writes = &ctx->queues[WRITE_QUEUE];
+   size_t nb_reads = reads->queued - reads->submitted;
+   size_t nb_writes = nb_writes_to_submit(ctx, nb_reads, writes->queued - writes->submitted);
+   size_t pending = nb_reads + nb_writes;
+   size_t nb_unsubmitted = ctx->nb_unsubmitted_ios;
+   if(pending == 0 && nb_unsubmitted == 0)
       return;
-   }
    /*if(pending > QUEUE_DEPTH)
       pending = QUEUE_DEPTH;*/
 
+   // IOs that the backend did not accept during the previous call are at the start of the batch, they are submitted first
+   struct iocb **iocbs = &ctx->iocbs[nb_unsubmitted];
+   dequeue_ios(ctx, reads, nb_reads, iocbs);
+   dequeue_ios(ctx, writes, nb_writes, &iocbs[nb_reads]);
    for(size_t i = 0; i < pending; i++) {
       struct slab_callback *callback;
-      ctx->iocbs[i] = &ctx->iocb[(ctx->processed_io + i)%ctx->max_pending_io];
-      callback = (void*)ctx->iocbs[i]->aio_data;
+      callback = (void*)iocbs[i]->aio_data;
       callback->lru_entry->dirty = 0;  // reset the dirty flag *before* sending write orders otherwise following writes might be ignored
                                        // race condition if flag is reset after:
                                        //        io_submit
@@ -127,11 +319,44 @@ static void worker_do_io(struct io_context *ctx) {
       add_time_in_payload(callback, 3);
    }
 
+   size_t nb_ios = pending;
+   if(MERGE_ADJACENT_IOS) { // reads and writes are merged separately so that reads stay first
+      size_t nb_merged_reads = merge_adjacent_ios(ctx, iocbs, nb_reads);
+      size_t nb_merged_writes = merge_adjacent_ios(ctx, &iocbs[nb_reads], nb_writes);
+      memmove(&iocbs[nb_merged_reads], &iocbs[nb_reads], nb_merged_writes * sizeof(*iocbs));
+      nb_ios = nb_merged_reads + nb_merged_writes;
+   }
+   nb_ios += nb_unsubmitted;
+
    // Submit requests to the kernel
-   int ret = io_submit(ctx->ctx, pending, ctx->iocbs);
-   if (ret != pending)
-      perr("Couldn't submit all io requests! %d submitted / %lu (%lu sent, %lu processed)\n", ret, pending, ctx->sent_io, ctx->processed_io);
-   ctx->ios_sent_to_disk = ret;
+   int ret = io_backend_submit(ctx->backend, nb_ios, ctx->iocbs);
+   if(ret < 0 && errno != EAGAIN && errno != EBUSY)
+      perr("Couldn't submit io requests! %d submitted / %lu (%lu sent, %lu processed)\n", ret, nb_ios, ctx->sent_io, ctx->processed_io);
+   if(ret < 0)
+      ret = 0;
+
+   // The backend may accept only part of the batch (full submission ring, kernel out of resources), the rest is submitted during the next call
+   ctx->nb_unsubmitted_ios = nb_ios - ret;
+   memmove(ctx->iocbs, &ctx->iocbs[ret], ctx->nb_unsubmitted_ios * sizeof(*ctx->iocbs));
+
+   ctx->ios_sent_to_disk += ret;
+   ctx->qd.in_flight += ctx->sent_io - ctx->processed_io;
+   ctx->qd.nb_submits++;
+}
+
+/* Reserve an IO slot and put it in the read or write submission queue */
+static struct iocb *queue_io(struct io_context *ctx, int queue) {
+   struct io_queue *q = &ctx->queues[queue];
+   if(ctx->sent_io - ctx->processed_io >= ctx->max_pending_io || !ctx->nb_free_iocbs)
+      die("Sent %lu ios, processed %lu (> %lu waiting), IO buffer is too full!\n", ctx->sent_io, ctx->processed_io, ctx->max_pending_io);
+   struct iocb *_iocb = ctx->free_iocbs[--ctx->nb_free_iocbs];
+   memset(_iocb, 0, sizeof(*_iocb));
+   ctx->merged_next[iocb_slot(ctx, _iocb)] = NULL;
+   rdtscll(ctx->queued_at[iocb_slot(ctx, _iocb)]);
+   q->iocbs[q->queued % ctx->max_pending_io] = _iocb;
+   q->queued++;
+   ctx->sent_io++;
+   return _iocb;
 }
 
 
@@ -156,7 +381,7 @@ char *read_page_async(struct slab_callback *callback) {
    struct io_context *ctx = get_io_context(callback->slab->ctx);
    uint64_t hash = get_hash_for_page(callback->slab->fd, page_num);
 
-   alread_used = get_page(get_pagecache(callback->slab->ctx), hash, &disk_page, &lru_entry);
+   alread_used = get_page(callback->slab->pagecache, hash, callback->scan, &disk_page, &lru_entry);
    callback->lru_entry = lru_entry;
    if(lru_entry->contains_data) {   // content is cached already
       callback->io_cb(callback);       // call the callback directly
@@ -164,85 +389,177 @@ char *read_page_async(struct slab_callback *callback) {
    }
 
    if(alread_used) { // Somebody else is already prefetching the same page!
-      struct linked_callbacks *linked_cb = malloc(sizeof(*linked_cb));
-      linked_cb->callback = callback;
-      linked_cb->next = ctx->linked_callbacks;
-      ctx->linked_callbacks = linked_cb; // link our callback
+      link_callback(&ctx->linked_callbacks, callback, 0); // link our callback
       return NULL;
    }
 
-   int buffer_idx = ctx->sent_io % ctx->max_pending_io;
-   struct iocb *_iocb = &ctx->iocb[buffer_idx];
-   memset(_iocb, 0, sizeof(*_iocb));
+   struct iocb *_iocb = queue_io(ctx, READ_QUEUE);
    _iocb->aio_fildes = callback->slab->fd;
    _iocb->aio_lio_opcode = IOCB_CMD_PREAD;
    _iocb->aio_buf = (uint64_t)disk_page;
    _iocb->aio_data = (uint64_t)callback;
    _iocb->aio_offset = page_num * PAGE_SIZE;
-   _iocb->aio_nbytes = PAGE_SIZE;
-   if(ctx->sent_io - ctx->processed_io >= ctx->max_pending_io)
-      die("Sent %lu ios, processed %lu (> %lu waiting), IO buffer is too full!\n", ctx->sent_io, ctx->processed_io, ctx->max_pending_io);
-   ctx->sent_io++;
+   _iocb->aio_nbytes = callback->slab->page_size;
 
    return NULL;
 }
 
+/* Queue the IO that writes the page of the callback */
+static void queue_write(struct io_context *ctx, struct slab_callback *callback) {
+   struct lru *lru_entry = callback->lru_entry;
+   uint64_t page_num = item_page_num(callback->slab, callback->slab_idx);
+
+   lru_entry->dirty = 1;
+   lru_entry->queued_writes++;
+
+   struct iocb *_iocb = queue_io(ctx, WRITE_QUEUE);
+   _iocb->aio_fildes = callback->slab->fd;
+   _iocb->aio_lio_opcode = IOCB_CMD_PWRITE;
+   _iocb->aio_buf = (uint64_t)lru_entry->page;
+   _iocb->aio_data = (uint64_t)callback;
+   _iocb->aio_offset = page_num * PAGE_SIZE;
+   _iocb->aio_nbytes = callback->slab->page_size;
+}
+
+static void write_back_flush_cb(struct slab_callback *flush) {
+   pool_free(flush);
+}
+
+/*
+ * Write-back cache: mark the page as dirty, it will be flushed later by worker_ioengine_flush_dirty_pages.
+ * Returns 0 if the page should be written through because too many pages of the page cache are dirty.
+ */
+
+static int write_back_page(struct io_context *ctx, struct slab_callback *callback) {
+   struct lru *lru_entry = callback->lru_entry;
+   struct pagecache *p = callback->slab->pagecache;
+
+   if(lru_entry->dirty_since) {
+      ctx->nb_absorbed_writes++;
+   } else {
+      if(p->nb_dirty_pages >= p->max_pages / 2)
+         return 0;
+
+      struct slab_callback *flush = pool_alloc(sizeof(*flush));
+      flush->slab = callback->slab;
+      flush->slab_idx = callback->slab_idx;
+      flush->lru_entry = lru_entry;
+      flush->io_cb = write_back_flush_cb;
+
+      struct linked_callbacks *dirty = pool_alloc(sizeof(*dirty));
+      dirty->callback = flush;
+      dirty->write = 0;
+      dirty->next = NULL;
+      if(ctx->dirty_pages_tail)
+         ctx->dirty_pages_tail->next = dirty;
+      else
+         ctx->dirty_pages = dirty;
+      ctx->dirty_pages_tail = dirty;
+
+      rdtscll(lru_entry->dirty_since);
+      p->nb_dirty_pages++;
+      ctx->nb_dirty_pages++;
+   }
+
+   if(callback->ack == ACK_ON_CACHE)
+      callback->io_cb(callback);
+   else
+      link_callback(&ctx->linked_callbacks, callback, lru_entry->queued_writes + 1); // called when the next write of the page (the flush) completes
+   return 1;
+}
+
 /* Enqueue a request to write a page, the lru entry must contain the content of the page (obviously) */
 char *write_page_async(struct slab_callback *callback) {
    struct io_context *ctx = get_io_context(callback->slab->ctx);
    struct lru *lru_entry = callback->lru_entry;
    void *disk_page = lru_entry->page;
-   uint64_t page_num = item_page_num(callback->slab, callback->slab_idx);
 
    if(!lru_entry->contains_data) {  // page is not in RAM! Abort!
       die("WTF?\n");
    }
 
+   if(WRITE_BACK_CACHE && write_back_page(ctx, callback))
+      return disk_page;
+
    if(lru_entry->dirty) { // this is the second time we write the page, which means it already has been queued for writting
-      struct linked_callbacks *linked_cb;
-      linked_cb = malloc(sizeof(*linked_cb));
-      linked_cb->callback = callback;
-      linked_cb->next = ctx->linked_callbacks;
-      ctx->linked_callbacks = linked_cb; // link our callback
+      link_callback(&ctx->linked_callbacks, callback, lru_entry->queued_writes); // called when the queued write completes
       return disk_page;
    }
 
-   lru_entry->dirty = 1;
-
-   int buffer_idx = ctx->sent_io % ctx->max_pending_io;
-   struct iocb *_iocb = &ctx->iocb[buffer_idx];
-   memset(_iocb, 0, sizeof(*_iocb));
-   _iocb->aio_fildes = callback->slab->fd;
-   _iocb->aio_lio_opcode = IOCB_CMD_PWRITE;
-   _iocb->aio_buf = (uint64_t)disk_page;
-   _iocb->aio_data = (uint64_t)callback;
-   _iocb->aio_offset = page_num * PAGE_SIZE;
-   _iocb->aio_nbytes = PAGE_SIZE;
-   if(ctx->sent_io - ctx->processed_io >= ctx->max_pending_io)
-      die("Sent %lu ios, processed %lu (> %lu waiting), IO buffer is too full!\n", ctx->sent_io, ctx->processed_io, ctx->max_pending_io);
-   ctx->sent_io++;
+   if(lru_entry->queued_writes != lru_entry->completed_writes) { // the page is being written, wait for the write to complete before writing it again
+      link_callback(&ctx->deferred_writes, callback, 0);
+      return disk_page;
+   }
 
+   queue_write(ctx, callback);
    return NULL;
 }
 
+/*
+ * Write-back cache: queue the writes of the pages that have been dirty for more than WRITE_BACK_DELAY_US, and of the oldest pages if the worker has
+ * more than WRITE_BACK_MAX_DIRTY_PAGES dirty pages.
+ */
+void worker_ioengine_flush_dirty_pages(struct io_context *ctx) {
+   uint64_t now;
+   rdtscll(now);
+
+   while(ctx->dirty_pages) {
+      struct linked_callbacks *dirty = ctx->dirty_pages;
+      struct slab_callback *flush = dirty->callback;
+      struct lru *lru_entry = flush->lru_entry;
+      if(ctx->nb_dirty_pages <= WRITE_BACK_MAX_DIRTY_PAGES && cycles_to_us(now - lru_entry->dirty_since) < WRITE_BACK_DELAY_US)
+         break; // the oldest dirty page can wait
+      if(lru_entry->dirty || lru_entry->queued_writes != lru_entry->completed_writes)
+         break; // the page is already being written, flush it once the write has completed
+      if(ctx->sent_io - ctx->processed_io >= ctx->max_pending_io / 2)
+         break; // keep room for the IOs of the requests
+
+      ctx->dirty_pages = dirty->next;
+      if(!ctx->dirty_pages)
+         ctx->dirty_pages_tail = NULL;
+      pool_free(dirty);
+
+      lru_entry->dirty_since = 0;
+      flush->slab->pagecache->nb_dirty_pages--;
+      ctx->nb_dirty_pages--;
+      queue_write(ctx, flush);
+   }
+}
+
 /*
  * Init an IO worker
  */
-struct io_context *worker_ioengine_init(size_t nb_callbacks) {
-   int ret;
+struct io_context *worker_ioengine_init(size_t nb_callbacks, struct pagecache *p) {
    struct io_context *ctx = calloc(1, sizeof(*ctx));
    ctx->max_pending_io = nb_callbacks * 2;
    ctx->iocb = calloc(ctx->max_pending_io, sizeof(*ctx->iocb));
+   ctx->free_iocbs = calloc(ctx->max_pending_io, sizeof(*ctx->free_iocbs));
+   for(size_t i = 0; i < ctx->max_pending_io; i++)
+      ctx->free_iocbs[i] = &ctx->iocb[i];
+   ctx->nb_free_iocbs = ctx->max_pending_io;
+   for(size_t i = 0; i < 2; i++)
+      ctx->queues[i].iocbs = calloc(ctx->max_pending_io, sizeof(*ctx->queues[i].iocbs));
+   ctx->queued_at = calloc(ctx->max_pending_io, sizeof(*ctx->queued_at));
+   ctx->submitted_at = calloc(ctx->max_pending_io, sizeof(*ctx->submitted_at));
+   ctx->qd.queue_depth = QUEUE_DEPTH;
+   ctx->qd.direction = 1;
+   rdtscll(ctx->qd.period_start);
+   ctx->merged_next = calloc(ctx->max_pending_io, sizeof(*ctx->merged_next));
+   if(MERGE_ADJACENT_IOS)
+      ctx->iovecs = calloc(ctx->max_pending_io * MAX_MERGED_IOS, sizeof(*ctx->iovecs));
    ctx->iocbs = calloc(ctx->max_pending_io, sizeof(*ctx->iocbs));
    ctx->events = calloc(ctx->max_pending_io, sizeof(*ctx->events));
-
-   ret = io_setup(ctx->max_pending_io, &ctx->ctx);
-   if(ret < 0)
-      perr("Cannot create aio setup\n");
+   // The memory of shared page caches is given back to the kernel when they shrink, it cannot be pinned by the backend
+   ctx->backend = io_backend_init(NULL, ctx->max_pending_io, p->cached_data, (p->capacity == p->max_pages)?p->max_pages * p->page_size:0);
 
    return ctx;
 }
 
+/* Register a file that will be accessed by the worker (only useful for io_uring) */
+void worker_ioengine_register_file(struct io_context *ctx, int fd) {
+   io_backend_register_file(ctx->backend, fd);
+}
+
 /* Enqueue requests */
 void worker_ioengine_enqueue_ios(struct io_context *ctx) {
    worker_do_io(ctx); // Process IO queue
@@ -257,40 +574,141 @@ void worker_ioengine_get_completed_ios(struct io_context *ctx) {
       return;
 
    start_debug_timer {
-      ret = io_getevents(ctx->ctx, ctx->ios_sent_to_disk - ret, ctx->ios_sent_to_disk - ret, &ctx->events[ret], NULL);
-      if(ret != ctx->ios_sent_to_disk)
+      size_t min_nr = PARTIAL_IO_COMPLETIONS?0:ctx->ios_sent_to_disk; // only wait if we must process all the IOs
+      size_t max_nr = ctx->ios_sent_to_disk;
+      ret = io_backend_getevents(ctx->backend, min_nr, max_nr, &ctx->events[ctx->nb_completed_io]);
+      if(ret < min_nr)
          die("Problem: only got %d answers out of %lu enqueued IO requests\n", ret, ctx->ios_sent_to_disk);
+      ctx->ios_sent_to_disk -= ret;
+      ctx->nb_completed_io += ret;
    } stop_debug_timer(10000, "io_getevents took more than 10ms!!");
 }
 
 
+/*
+ * Adaptive queue depth: at the end of each period,
+ *  - if the average latency of IOs exceeded ADAPTIVE_QD_LATENCY_CEILING_US, the depth is reduced by 25%,
+ *  - otherwise, if the depth was actually reached (i.e., the disk had enough requests), the depth moves by 1/8 in the current direction, and the
+ *    direction is reversed when throughput dropped by more than 5% since the previous period (hill climbing towards the best throughput).
+ *
+ * Only the depth is tuned. MAX_NB_PENDING_CALLBACKS_PER_WORKER sizes the callback ring, the iocbs and the rings of the IO backend when the worker
+ * starts, so it stays the fixed bound within which the depth moves. NEVER_EXCEED_QUEUE_DEPTH and WAIT_A_BIT_FOR_MORE_IOS compare the pending IOs
+ * to io_queue_depth(), so they already follow the adapted depth.
+ */
+static void adjust_queue_depth(struct io_context *ctx, uint64_t now) {
+   struct queue_depth_controller *qd = &ctx->qd;
+   uint64_t elapsed = cycles_to_us(now - qd->period_start);
+   if(elapsed < ADAPTIVE_QD_PERIOD_US)
+      return;
+
+   if(qd->nb_ios) {
+      size_t latency = cycles_to_us(qd->latency / qd->nb_ios);
+      size_t throughput = qd->nb_pages * 1000000LU / elapsed;
+      size_t avg_in_flight = qd->nb_submits?(qd->in_flight / qd->nb_submits):0;
+      size_t step = qd->queue_depth / 8;
+      if(step == 0)
+         step = 1;
+
+      if(latency > ADAPTIVE_QD_LATENCY_CEILING_US) {
+         qd->queue_depth = qd->queue_depth * 3 / 4;
+         qd->direction = 1;
+      } else if(avg_in_flight * 2 >= qd->queue_depth) {
+         if(throughput < qd->last_throughput * 95 / 100)
+            qd->direction = -qd->direction;
+         qd->queue_depth += qd->direction * step;
+      }
+      if(qd->queue_depth < ADAPTIVE_QD_MIN)
+         qd->queue_depth = ADAPTIVE_QD_MIN;
+      if(qd->queue_depth > ctx->max_pending_io / 2)
+         qd->queue_depth = ctx->max_pending_io / 2;
+
+      qd->last_latency = latency;
+      qd->last_throughput = throughput;
+   }
+
+   qd->period_start = now;
+   qd->latency = 0;
+   qd->nb_ios = 0;
+   qd->nb_pages = 0;
+   qd->in_flight = 0;
+   qd->nb_submits = 0;
+}
+
 void worker_ioengine_process_completed_ios(struct io_context *ctx) {
-   int ret = ctx->ios_sent_to_disk;
+   int ret = ctx->nb_completed_io;
+   size_t nb_pages = 0;
+   uint64_t now;
    declare_debug_timer;
 
-   if(ctx->ios_sent_to_disk == 0)
+   if(ret == 0)
       return;
 
-
+   rdtscll(now);
    start_debug_timer {
       // Enqueue completed IO requests
       for(size_t i = 0; i < ret; i++) {
          struct iocb *cb = (void*)ctx->events[i].obj;
-         struct slab_callback *callback = (void*)cb->aio_data;
-         assert(ctx->events[i].res == 4096); // otherwise page hasn't been read
-         callback->lru_entry->contains_data = 1;
-         //callback->lru_entry->dirty = 0; // done before
-         callback->io_cb(callback);
+         ctx->qd.latency += now - ctx->submitted_at[iocb_slot(ctx, cb)];
+         int write = (cb->aio_lio_opcode == IOCB_CMD_PWRITE || cb->aio_lio_opcode == IOCB_CMD_PWRITEV);
+         if(ctx->events[i].res != iocb_size(cb)) // otherwise page hasn't been read
+            die("IO failed (returned %lld), if you use uring-iopoll or uring-poll check that the device has poll queues\n", ctx->events[i].res);
+
+         while(cb) { // all the pages of a merged IO
+            struct iocb *next = ctx->merged_next[iocb_slot(ctx, cb)];
+            struct slab_callback *callback = (void*)cb->aio_data;
+            callback->lru_entry->contains_data = 1;
+            //callback->lru_entry->dirty = 0; // done before
+            if(write)
+               callback->lru_entry->completed_writes++;
+            ctx->free_iocbs[ctx->nb_free_iocbs++] = cb; // the slot can be reused by the callback
+            callback->io_cb(callback);
+            cb = next;
+            nb_pages++;
+         }
       }
+      ctx->nb_completed_io = 0;
 
       // We might have "linked callbacks" so process them
       process_linked_callbacks(ctx);
+      process_deferred_writes(ctx);
    } stop_debug_timer(10000, "rest of worker_ioengine_process_completed_ios (%d requests)", ret);
 
    // Ok, now the main thread can push more requests
-   ctx->processed_io += ctx->ios_sent_to_disk;
+   ctx->processed_io += nb_pages;
+
+   ctx->qd.nb_ios += ret;
+   ctx->qd.nb_pages += nb_pages;
+   if(ADAPTIVE_QUEUE_DEPTH)
+      adjust_queue_depth(ctx, now);
 }
 
 int io_pending(struct io_context *ctx) {
    return ctx->sent_io - ctx->processed_io;
 }
+
+int io_queue_depth(struct io_context *ctx) {
+   return ctx->qd.queue_depth;
+}
+
+int io_dirty_pages(struct io_context *ctx) {
+   return ctx->nb_dirty_pages;
+}
+
+/*
+ * Stats of the engine since the last call, displayed in the worker breakdown
+ */
+const char *worker_ioengine_stats(struct io_context *ctx) {
+   struct io_queue *reads = &ctx->queues[READ_QUEUE], *writes = &ctx->queues[WRITE_QUEUE];
+   snprintf(ctx->stats, sizeof(ctx->stats), "%lu IO syscalls - %lu merged IOs - %lu absorbed writes (%lu dirty pages) - queueing %lu us/read %lu us/write - queue depth %lu (%lu us/IO, %lu pages/s)",
+         io_backend_syscalls(ctx->backend), ctx->nb_merged_io, ctx->nb_absorbed_writes, ctx->nb_dirty_pages,
+         reads->nb_submitted?cycles_to_us(reads->queueing_time / reads->nb_submitted):0,
+         writes->nb_submitted?cycles_to_us(writes->queueing_time / writes->nb_submitted):0,
+         ctx->qd.queue_depth, ctx->qd.last_latency, ctx->qd.last_throughput);
+   for(size_t i = 0; i < 2; i++) {
+      ctx->queues[i].queueing_time = 0;
+      ctx->queues[i].nb_submitted = 0;
+   }
+   ctx->nb_merged_io = 0;
+   ctx->nb_absorbed_writes = 0;
+   return ctx->stats;
+}
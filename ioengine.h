@@ -2,16 +2,31 @@
 #define IOENGINE_H 1
 
 
-struct io_context *worker_ioengine_init(size_t nb_callbacks);
+void set_io_engine(const char *name);
+const char *get_io_engine_name(void);
 
-void *safe_pread(int fd, off_t offset);
+struct io_backend_ctx *io_backend_init(const char *name, size_t max_pending_io, char *buffers, size_t buffers_size);
+void io_backend_register_file(struct io_backend_ctx *b, int fd);
+int io_backend_submit(struct io_backend_ctx *b, size_t nr, struct iocb **iocbs);
+int io_backend_getevents(struct io_backend_ctx *b, size_t min_nr, size_t max_nr, struct io_event *events);
+size_t io_backend_syscalls(struct io_backend_ctx *b);
+void io_backend_destroy(struct io_backend_ctx *b);
+
+struct io_context *worker_ioengine_init(size_t nb_callbacks, struct pagecache *p);
+void worker_ioengine_register_file(struct io_context *ctx, int fd);
+
+void *safe_pread(int fd, off_t offset, size_t size);
 
 typedef void (io_cb_t)(struct slab_callback *);
 char *read_page_async(struct slab_callback *cb);
 char *write_page_async(struct slab_callback *cb);
 
 int io_pending(struct io_context *ctx);
+int io_queue_depth(struct io_context *ctx);
+int io_dirty_pages(struct io_context *ctx);
+const char *worker_ioengine_stats(struct io_context *ctx);
 
+void worker_ioengine_flush_dirty_pages(struct io_context *ctx);
 void worker_ioengine_enqueue_ios(struct io_context *ctx);
 void worker_ioengine_get_completed_ios(struct io_context *ctx);
 void worker_ioengine_process_completed_ios(struct io_context *ctx);
@@ -0,0 +1,184 @@
+#include "headers.h"
+
+/*
+ * Item cache: caches hot items that are smaller than ITEM_CACHE_MAX_ITEM_SIZE (ITEM_CACHE).
+ *
+ * Caching a 4KB page to keep a single hot 100B item in memory wastes most of the page cache, so each worker can also keep copies of its hot
+ * items in a compact arena. Reads look in the item cache first (read_item_async), after the lookup of the item in the in-memory index.
+ * Items are identified by their location in the slabs (fd << 40 + slab_idx), which is what the index gives for the prefix of the key.
+ *
+ * The arena is slab allocated, like memcached: each item size has a class of fixed size slots, allocated by chunks of ITEM_CACHE_CHUNK_SIZE
+ * bytes until the budget of the worker is used. Then a class reuses its own slots, chosen by CLOCK.
+ * The index is sized for items of ITEM_CACHE_MIN_ITEM_SIZE bytes (sizing it for the smallest slab would make it larger than the cached items
+ * on workloads with 1KB items), so the budget of workers that only cache smaller items is not fully used.
+ * Only hot items are cached: an item is cached when it is read from the page cache for the second time since the doorkeeper (a bitmap of
+ * the items that have been read once) was last cleared. Reads of scans are never cached.
+ *
+ * The copies are kept consistent with the page cache: when an item is written in its page (update_item_async_cb1) or deleted, the copy is
+ * updated or removed. So reads served by the item cache return the content of the page cache.
+ */
+
+#define ITEM_CACHE_MIN_ITEM_SIZE 256
+
+struct item_cache_slot {
+   uint64_t key;
+   int used;
+   int referenced;
+};
+
+struct item_cache_chunk {
+   char *data;
+   struct item_cache_slot *slots;
+};
+
+struct item_cache_class {
+   size_t item_size;
+   size_t slots_per_chunk;
+   struct item_cache_chunk *chunks;
+   size_t nb_chunks;
+   size_t nb_slots, hand;
+};
+
+static uint64_t item_key(struct slab *s, size_t idx) {
+   return (((uint64_t)s->fd)<<40LU) + idx;
+}
+
+struct itemcache *item_cache_init(size_t cache_size) {
+   struct itemcache *c = calloc(1, sizeof(*c));
+   c->max_items = cache_size / ITEM_CACHE_MIN_ITEM_SIZE;
+   c->index = hashtable_create(c->max_items);
+   c->classes = calloc(MAX_SLAB_CLASSES, sizeof(*c->classes));
+   c->max_chunks = cache_size / ITEM_CACHE_CHUNK_SIZE;
+   c->nb_seen_bits = 8 * c->max_items;
+   c->seen = calloc(c->nb_seen_bits / 64 + 1, sizeof(*c->seen));
+   return c;
+}
+
+/* The class of the items of slab s, NULL if they are not cached */
+static struct item_cache_class *get_class(struct itemcache *c, struct slab *s) {
+   if(s->item_size > ITEM_CACHE_MAX_ITEM_SIZE)
+      return NULL;
+   for(size_t i = 0; i < c->nb_classes; i++)
+      if(c->classes[i].item_size == s->item_size)
+         return &c->classes[i];
+   assert(c->nb_classes < MAX_SLAB_CLASSES);
+   struct item_cache_class *cl = &c->classes[c->nb_classes++];
+   cl->item_size = s->item_size;
+   cl->slots_per_chunk = ITEM_CACHE_CHUNK_SIZE / s->item_size;
+   return cl;
+}
+
+/* Doorkeeper: returns 1 if the item has already been seen, and remembers it otherwise */
+static int item_seen(struct itemcache *c, uint64_t key) {
+   uint64_t bit = (key * 0x9E3779B97F4A7C15LU) % c->nb_seen_bits;
+   if(c->seen[bit / 64] & (1LU << (bit % 64)))
+      return 1;
+   c->seen[bit / 64] |= 1LU << (bit % 64);
+   c->nb_seen++;
+   if(c->nb_seen > c->nb_seen_bits / 8) { // too many false positives, forget everything
+      memset(c->seen, 0, (c->nb_seen_bits / 64 + 1) * sizeof(*c->seen));
+      c->nb_seen = 0;
+   }
+   return 0;
+}
+
+/* Get a slot for a new item: a never used slot, a new chunk, or an evicted slot (CLOCK) */
+static size_t get_slot(struct itemcache *c, struct item_cache_class *cl) {
+   if(cl->nb_slots == cl->nb_chunks * cl->slots_per_chunk && c->nb_chunks < c->max_chunks
+         && c->nb_items + cl->slots_per_chunk <= c->max_items) {
+      cl->chunks = realloc(cl->chunks, (cl->nb_chunks + 1) * sizeof(*cl->chunks));
+      cl->chunks[cl->nb_chunks].data = malloc(ITEM_CACHE_CHUNK_SIZE);
+      cl->chunks[cl->nb_chunks].slots = calloc(cl->slots_per_chunk, sizeof(struct item_cache_slot));
+      cl->nb_chunks++;
+      c->nb_chunks++;
+      c->nb_items += cl->slots_per_chunk;
+   }
+   if(cl->nb_slots < cl->nb_chunks * cl->slots_per_chunk)
+      return cl->nb_slots++;
+   if(!cl->nb_slots)
+      return -1; // the budget was used by other classes
+
+   while(1) {
+      size_t slot = cl->hand;
+      struct item_cache_slot *meta = &cl->chunks[slot / cl->slots_per_chunk].slots[slot % cl->slots_per_chunk];
+      cl->hand = (cl->hand + 1) % cl->nb_slots;
+      if(meta->used && meta->referenced) {
+         meta->referenced = 0;
+         continue;
+      }
+      if(meta->used)
+         hashtable_delete(c->index, meta->key);
+      return slot;
+   }
+}
+
+char *item_cache_get(struct itemcache *c, struct slab *s, size_t idx) {
+   if(s->item_size > ITEM_CACHE_MAX_ITEM_SIZE)
+      return NULL;
+   struct index_entry *e = hashtable_lookup(c->index, item_key(s, idx));
+   if(!e) {
+      c->misses++;
+      return NULL;
+   }
+   struct item_cache_slot *meta = e->lru;
+   if(!meta->referenced)
+      meta->referenced = 1;
+   c->hits++;
+   return e->page;
+}
+
+/* The item has been read from the page cache, cache it if it is hot */
+void item_cache_admit(struct itemcache *c, struct slab *s, size_t idx, char *item) {
+   struct item_cache_class *cl = get_class(c, s);
+   if(!cl || ((struct item_metadata *)item)->key_size == -1)
+      return;
+   uint64_t key = item_key(s, idx);
+   if(!item_seen(c, key) || hashtable_lookup(c->index, key))
+      return;
+
+   size_t slot = get_slot(c, cl);
+   if(slot == -1)
+      return;
+   struct item_cache_chunk *chunk = &cl->chunks[slot / cl->slots_per_chunk];
+   struct item_cache_slot *meta = &chunk->slots[slot % cl->slots_per_chunk];
+   char *copy = &chunk->data[(slot % cl->slots_per_chunk) * cl->item_size];
+   memcpy(copy, item, get_item_size(item));
+   meta->key = key;
+   meta->used = 1;
+   meta->referenced = 0;
+   struct index_entry e = { .page = copy, .lru = meta };
+   hashtable_insert(c->index, key, &e);
+}
+
+/* The item has been modified in the page cache, update its copy */
+void item_cache_update(struct itemcache *c, struct slab *s, size_t idx, char *item) {
+   if(s->item_size > ITEM_CACHE_MAX_ITEM_SIZE)
+      return;
+   if(((struct item_metadata *)item)->key_size == -1) {
+      item_cache_remove(c, s, idx);
+      return;
+   }
+   struct index_entry *e = hashtable_lookup(c->index, item_key(s, idx));
+   if(e)
+      memcpy(e->page, item, get_item_size(item));
+}
+
+void item_cache_remove(struct itemcache *c, struct slab *s, size_t idx) {
+   if(s->item_size > ITEM_CACHE_MAX_ITEM_SIZE)
+      return;
+   uint64_t key = item_key(s, idx);
+   struct index_entry *e = hashtable_lookup(c->index, key);
+   if(!e)
+      return;
+   struct item_cache_slot *meta = e->lru;
+   meta->used = 0;
+   hashtable_delete(c->index, key);
+}
+
+/* Memory used by the copies of the items and their metadata */
+size_t item_cache_memory(struct itemcache *c) {
+   size_t memory = hashtable_memory(c->index) + c->nb_seen_bits / 8;
+   for(size_t i = 0; i < c->nb_classes; i++)
+      memory += c->classes[i].nb_chunks * (ITEM_CACHE_CHUNK_SIZE + c->classes[i].slots_per_chunk * sizeof(struct item_cache_slot));
+   return memory;
+}
@@ -0,0 +1,28 @@
+#ifndef ITEM_CACHE_H
+#define ITEM_CACHE_H 1
+
+#include "indexes/hashtable.h"
+
+struct slab;
+struct item_cache_class;
+
+struct itemcache {
+   hashtable_t *index;                 // location of the item (fd << 40 + slab_idx) -> cached copy
+   struct item_cache_class *classes;   // one class per item size
+   size_t nb_classes;
+   size_t max_chunks, nb_chunks;       // memory is allocated by chunks of ITEM_CACHE_CHUNK_SIZE
+   size_t max_items, nb_items;         // number of slots the index has been sized for, and number of allocated slots
+   uint64_t *seen;                     // doorkeeper: items are only cached when they are read a second time
+   size_t nb_seen_bits, nb_seen;
+   size_t hits, misses;
+   size_t reported_hits, reported_misses;
+};
+
+struct itemcache *item_cache_init(size_t cache_size);
+char *item_cache_get(struct itemcache *c, struct slab *s, size_t idx);
+void item_cache_admit(struct itemcache *c, struct slab *s, size_t idx, char *item);
+void item_cache_update(struct itemcache *c, struct slab *s, size_t idx, char *item);
+void item_cache_remove(struct itemcache *c, struct slab *s, size_t idx);
+size_t item_cache_memory(struct itemcache *c);
+
+#endif
@@ -14,19 +14,40 @@ int main(int argc, char **argv) {
 
 
    /* Parsing of the options */
-   if(argc < 3)
-      die("Usage: ./main <nb disks> <nb workers per disk>\n\tData is stored in %s\n", PATH);
-   nb_disks = atoi(argv[1]);
-   nb_workers_per_disk = atoi(argv[2]);
+   int opt;
+   while((opt = getopt(argc, argv, "e:c:n:s:")) != -1) {
+      switch(opt) {
+         case 'e':
+            set_io_engine(optarg);
+            break;
+         case 'c':
+            page_cache_resize(atol(optarg)*1024LU*1024LU);
+            break;
+         case 's':
+            slab_classes_set(optarg);
+            break;
+         case 'n':
+            numa_set_disk_nodes(optarg);
+            break;
+         default:
+            die("Usage: ./main [-e aio|uring|threads] [-c <page cache size in MB>] [-n <NUMA node of each disk, e.g. 0,1>] [-s <slab classes of a new database, e.g. 128,256,4096>] <nb disks> <nb workers per disk>\n\tData is stored in %s\n", PATH);
+      }
+   }
+   if(argc - optind < 2)
+      die("Usage: ./main [-e aio|uring|threads] [-c <page cache size in MB>] [-n <NUMA node of each disk, e.g. 0,1>] [-s <slab classes of a new database, e.g. 128,256,4096>] <nb disks> <nb workers per disk>\n\tData is stored in %s\n", PATH);
+   nb_disks = atoi(argv[optind]);
+   nb_workers_per_disk = atoi(argv[optind + 1]);
 
    /* Pretty printing useful info */
    printf("# Configuration:\n");
-   printf("# \tPage cache size: %lu GB\n", PAGE_CACHE_SIZE/1024/1024/1024);
+   printf("# \tPage cache size: %lu MB (shared between workers: %s)\n", page_cache_size()/1024/1024, SHARED_PAGE_CACHE?"yes":"no");
    printf("# \tWorkers: %d working on %d disks\n", nb_disks*nb_workers_per_disk, nb_disks);
-   printf("# \tIO configuration: %d queue depth (capped: %s, extra waiting: %s)\n", QUEUE_DEPTH, NEVER_EXCEED_QUEUE_DEPTH?"yes":"no", WAIT_A_BIT_FOR_MORE_IOS?"yes":"no");
+   printf("# \tIO engine: %s\n", get_io_engine_name());
+   printf("# \tIO configuration: %d queue depth (adaptive: %s, capped: %s, extra waiting: %s, partial completions: %s, merged IOs: %s)\n", QUEUE_DEPTH, ADAPTIVE_QUEUE_DEPTH?"yes":"no", NEVER_EXCEED_QUEUE_DEPTH?"yes":"no", WAIT_A_BIT_FOR_MORE_IOS?"yes":"no", PARTIAL_IO_COMPLETIONS?"yes":"no", MERGE_ADJACENT_IOS?"yes":"no");
+   printf("# \tIO scheduler: %d (write weight %d%%, max writes per batch %d)\n", IO_SCHEDULER, IO_SCHED_WRITE_WEIGHT, IO_SCHED_MAX_WRITES_PER_BATCH);
    printf("# \tQueue configuration: %d maximum pending callbaks per worker\n", MAX_NB_PENDING_CALLBACKS_PER_WORKER);
    printf("# \tDatastructures: %d (memory index) %d (pagecache)\n", MEMORY_INDEX, PAGECACHE_INDEX);
-   printf("# \tThread pinning: %s\n", PINNING?"yes":"no");
+   printf("# \tThread pinning: %s (NUMA placement: %s)\n", PINNING?"yes":"no", NUMA_PLACEMENT?"yes":"no");
    printf("# \tBench: %s (%lu elements)\n", w.api->api_name(), w.nb_items_in_db);
 
    /* Initialization of random library */
@@ -43,6 +64,13 @@ int main(int argc, char **argv) {
    /* Add missing items if any */
    repopulate_db(&w);
 
+   /* Move the items in key order in the slabs */
+   if(SLAB_CLUSTERING) {
+      start_timer {
+         cluster_slabs();
+      } stop_timer("Clustering of the slabs");
+   }
+
    /* Launch benchs */
    bench_t workload, workloads[] = {
       ycsb_a_uniform, ycsb_b_uniform, ycsb_c_uniform,
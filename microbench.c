@@ -24,29 +24,14 @@ struct pdata {
    size_t nb_accesses;
    size_t nb_pages;
    size_t rw;
+   const char *engine;
 };
 
 static char *path = NULL;
 static int nb_threads = 0;
 
-static int io_setup(unsigned nr, aio_context_t *ctxp) {
-	return syscall(__NR_io_setup, nr, ctxp);
-}
-
-static int io_destroy(aio_context_t ctx) {
-	return syscall(__NR_io_destroy, ctx);
-}
-
-static int io_submit(aio_context_t ctx, long nr, struct iocb **iocbpp) {
-	return syscall(__NR_io_submit, ctx, nr, iocbpp);
-}
-
-static int io_getevents(aio_context_t ctx, long min_nr, long max_nr,
-		struct io_event *events, struct timespec *timeout) {
-	return syscall(__NR_io_getevents, ctx, min_nr, max_nr, events, timeout);
-}
-
-void *do_libaio(void *data) {
+/* Same IO pattern for all the IO engines (see ioengine-backend.c): submit queue_size random IOs, wait for all of them */
+void *do_io_backend(void *data) {
    int tid = __sync_fetch_and_add(&nb_threads, 1);
 
    struct pdata *pdata = data;
@@ -56,20 +41,14 @@ void *do_libaio(void *data) {
    size_t nb_pages = pdata->nb_pages;
    unsigned int seed = rand();
 
-   aio_context_t ctx;
-   memset(&ctx, 0, sizeof(ctx));
-
    struct iocb cb[1024];
    struct iocb *cbs[1024];
    struct io_event events[1024];
    int ret;
    char *buffers = aligned_alloc(PAGE_SIZE, PAGE_SIZE * queue_size);
 
-   ret = io_setup(1024, &ctx);
-   if (ret < 0) {
-      perror("io_setup");
-      exit(-1);
-   }
+   struct io_backend_ctx *backend = io_backend_init(pdata->engine, 1024, buffers, PAGE_SIZE * queue_size);
+   io_backend_register_file(backend, fd);
 
    declare_periodic_count;
    declare_breakdown;
@@ -97,28 +76,23 @@ void *do_libaio(void *data) {
 
          cbs[j] = &cb[j];
 
-         periodic_count(1000, "[TID %d] LibAIO", tid);
+         periodic_count(1000, "[TID %d] %s", tid, pdata->engine);
          i++;
       }
 
-      ret = io_submit(ctx, queue_size, cbs);
+      ret = io_backend_submit(backend, queue_size, cbs);
       if (ret != queue_size) {
          if (ret < 0) perror("io_submit");
          else fprintf(stderr, "io_submit only submitted %d\n", ret);
       } __1
-      ret = io_getevents(ctx, ret, ret, events, NULL); __2
+      ret = io_backend_getevents(backend, ret, ret, events); __2
 
       wait_for(450000); __3
 
       show_breakdown_periodic(1000, i, "io_submit", "io_getevents", "waiting", "unused", "unused");
    }
 
-   ret = io_destroy(ctx);
-   if (ret < 0) {
-      perror("io_destroy");
-      exit(-1);
-   }
-
+   io_backend_destroy(backend);
    free(pdata);
    free(buffers);
 
@@ -166,27 +140,31 @@ int bench_io(void) {
    close(fd);
    fd = open(path,  O_RDWR | O_CREAT | O_NONBLOCK | O_DIRECT, 0777);
 
-   /* libaio perf - various queue size */
+   /* IO engines perf - various queue size */
+   const char *engines[] = { "aio", "uring", "threads" };
    size_t queue_sizes[] = { 56 };
-   for(size_t rw = RO; rw <= RO; rw++) {
-      for(size_t q = 0; q < sizeof(queue_sizes)/sizeof(*queue_sizes); q++) {
-         size_t queue_size = queue_sizes[q];
-
-         start_timer {
-            pthread_t threads[NB_THREADS];
-            for(size_t i = 0; i < NB_THREADS; i++) {
-               struct pdata *data = malloc(sizeof(*data));
-               data->fd = fd;
-               data->rw = rw;
-               data->queue_size = queue_size;
-               data->nb_accesses = NB_ACCESSES / NB_THREADS;
-               data->nb_pages = nb_pages;
-               pthread_create(&threads[i], NULL, do_libaio, data);
-            }
-            for(size_t i = 0; i < NB_THREADS; i++) {
-               pthread_join(threads[i], NULL);
-            }
-         } stop_timer("libaio %d threads - %s - Time for %lu accesses queue size %lu = %lums (%lu io/s)", NB_THREADS, rw_to_str(rw), NB_ACCESSES, queue_size, elapsed/1000, NB_ACCESSES*1000000LU/elapsed);
+   for(size_t e = 0; e < sizeof(engines)/sizeof(*engines); e++) {
+      for(size_t rw = RO; rw <= RO; rw++) {
+         for(size_t q = 0; q < sizeof(queue_sizes)/sizeof(*queue_sizes); q++) {
+            size_t queue_size = queue_sizes[q];
+
+            start_timer {
+               pthread_t threads[NB_THREADS];
+               for(size_t i = 0; i < NB_THREADS; i++) {
+                  struct pdata *data = malloc(sizeof(*data));
+                  data->fd = fd;
+                  data->rw = rw;
+                  data->queue_size = queue_size;
+                  data->nb_accesses = NB_ACCESSES / NB_THREADS;
+                  data->nb_pages = nb_pages;
+                  data->engine = engines[e];
+                  pthread_create(&threads[i], NULL, do_io_backend, data);
+               }
+               for(size_t i = 0; i < NB_THREADS; i++) {
+                  pthread_join(threads[i], NULL);
+               }
+            } stop_timer("%s %d threads - %s - Time for %lu accesses queue size %lu = %lums (%lu io/s)", engines[e], NB_THREADS, rw_to_str(rw), NB_ACCESSES, queue_size, elapsed/1000, NB_ACCESSES*1000000LU/elapsed);
+         }
       }
    }
 
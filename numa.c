@@ -0,0 +1,194 @@
+#include "headers.h"
+#include <libgen.h>
+#include <sched.h>
+#include <sys/sysmacros.h>
+#include <linux/mempolicy.h>
+
+/*
+ * NUMA placement of the workers (NUMA_PLACEMENT).
+ *
+ * Workers run on the NUMA node of their disk, so that the IOs of a worker don't cross the socket interconnect. The node of a disk is
+ * given on the command line (-n option of main, e.g. -n 0,1 for 2 disks) or read from sysfs: the numa_node of the PCIe device of the block
+ * device that holds the directory of the disk (see PATH). A worker is pinned on a core of its node (PINNING) or allowed on all of them.
+ *
+ * The memory allocated by a worker is allocated on its node (set_mempolicy): its index, its item cache, its callbacks ring. The page cache
+ * is also bound to the node (mbind) because it is faulted lazily, possibly by another thread (page_cache_prefault).
+ * Nodes are preferred, not enforced: when a node is full, memory is allocated on another node.
+ *
+ * Load injectors are pinned on the cores that are not used by workers.
+ * The topology is read from /sys/devices/system/node, libnuma is not needed.
+ */
+
+#define NUMA_MAX_NODES 64
+
+struct numa_node {
+   int *cpus;
+   size_t nb_cpus;
+   size_t next_cpu;        // next core given to a worker
+};
+
+static struct numa_node nodes[NUMA_MAX_NODES];
+static int *disk_nodes;     // -n option
+static size_t nb_disk_nodes;
+static int *worker_nodes, *worker_cores;
+static int *injector_cores; // cores not used by workers
+static size_t nb_injector_cores;
+static __thread int my_node = -1;
+
+/* Parse a list of ranges ("0-3,8-11"), returns the number of values */
+static size_t parse_list(const char *list, int **values) {
+   size_t nb_values = 0;
+   *values = NULL;
+   const char *c = list;
+   while(*c && *c != '\n') {
+      char *end;
+      int first = strtol(c, &end, 10);
+      int last = first;
+      if(end == c)
+         break;
+      if(*end == '-')
+         last = strtol(end + 1, &end, 10);
+      for(int v = first; v <= last; v++) {
+         *values = realloc(*values, (nb_values + 1) * sizeof(**values));
+         (*values)[nb_values++] = v;
+      }
+      c = (*end == ',')?(end + 1):end;
+   }
+   return nb_values;
+}
+
+static char *read_sysfs(const char *path, char *buf, size_t len) {
+   FILE *f = fopen(path, "r");
+   if(!f)
+      return NULL;
+   char *res = fgets(buf, len, f);
+   fclose(f);
+   return res;
+}
+
+void numa_set_disk_nodes(const char *list) {
+   nb_disk_nodes = parse_list(list, &disk_nodes);
+}
+
+/* Node of the PCIe device of the disk, -1 if unknown */
+static int disk_node(int disk, const char **source) {
+   if(disk < nb_disk_nodes) {
+      *source = "command line";
+      return disk_nodes[disk];
+   }
+
+   *source = "unknown";
+   char path[512], sys_path[PATH_MAX], buf[64];
+   struct stat st;
+   sprintf(path, PATH, (size_t)disk, 0, 0LU, 0LU);
+   if(stat(dirname(path), &st))
+      return -1;
+   sprintf(path, "/sys/dev/block/%u:%u", major(st.st_dev), minor(st.st_dev));
+   if(!realpath(path, sys_path))
+      return -1;
+   while(strlen(sys_path) > strlen("/sys/devices")) { // numa_node is a file of the PCIe device, which is an ancestor of the block device
+      char file[PATH_MAX + 16];
+      sprintf(file, "%s/numa_node", sys_path);
+      if(read_sysfs(file, buf, sizeof(buf)) && atoi(buf) >= 0) {
+         *source = "sysfs";
+         return atoi(buf);
+      }
+      *strrchr(sys_path, '/') = '\0';
+   }
+   return -1;
+}
+
+void numa_init(int nb_disks, int nb_workers_per_disk) {
+   char buf[4096];
+   int *online = NULL;
+   size_t nb_online = 0;
+   if(read_sysfs("/sys/devices/system/node/online", buf, sizeof(buf)))
+      nb_online = parse_list(buf, &online);
+   for(size_t i = 0; i < nb_online; i++) {
+      char path[128];
+      if(online[i] >= NUMA_MAX_NODES)
+         die("Too many NUMA nodes, increase NUMA_MAX_NODES\n");
+      sprintf(path, "/sys/devices/system/node/node%d/cpulist", online[i]);
+      if(read_sysfs(path, buf, sizeof(buf)))
+         nodes[online[i]].nb_cpus = parse_list(buf, &nodes[online[i]].cpus);
+   }
+   free(online);
+   int first_node = -1;
+   for(int n = 0; n < NUMA_MAX_NODES && first_node < 0; n++)
+      if(nodes[n].nb_cpus)
+         first_node = n;
+   if(first_node < 0) { // no NUMA support in the kernel, a single node with all the cores
+      first_node = 0;
+      nodes[0].nb_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+      nodes[0].cpus = malloc(nodes[0].nb_cpus * sizeof(*nodes[0].cpus));
+      for(size_t i = 0; i < nodes[0].nb_cpus; i++)
+         nodes[0].cpus[i] = i;
+   }
+
+   size_t nb_workers = nb_disks * nb_workers_per_disk;
+   worker_nodes = malloc(nb_workers * sizeof(*worker_nodes));
+   worker_cores = malloc(nb_workers * sizeof(*worker_cores));
+   printf("#NUMA placement:\n");
+   for(int d = 0; d < nb_disks; d++) {
+      const char *source;
+      int node = disk_node(d, &source);
+      if(node < 0 || node >= NUMA_MAX_NODES || !nodes[node].nb_cpus) { // unknown node, or a node without cores (e.g., a disk attached to a memory only node)
+         if(node >= 0)
+            printf("#\tDisk %d: node %d (%s) has no core\n", d, node, source);
+         node = first_node;
+         source = "default";
+      }
+      printf("#\tDisk %d: node %d (%s), workers", d, node, source);
+      for(int i = 0; i < nb_workers_per_disk; i++) {
+         int w = d * nb_workers_per_disk + i;
+         struct numa_node *n = &nodes[node];
+         worker_nodes[w] = node;
+         worker_cores[w] = n->cpus[n->next_cpu++ % n->nb_cpus];
+         printf(" %d (core %d)", w, worker_cores[w]);
+      }
+      printf("\n");
+   }
+
+   for(int n = 0; n < NUMA_MAX_NODES; n++) {
+      for(size_t i = nodes[n].next_cpu; i < nodes[n].nb_cpus; i++) {
+         injector_cores = realloc(injector_cores, (nb_injector_cores + 1) * sizeof(*injector_cores));
+         injector_cores[nb_injector_cores++] = nodes[n].cpus[i];
+      }
+   }
+   printf("#\tLoad injectors: %lu free cores%s\n", nb_injector_cores, nb_injector_cores?"":" (injectors share the cores of the workers)");
+}
+
+/* Called by the worker, before it allocates its data structures */
+void numa_place_worker(int worker_id) {
+   my_node = worker_nodes[worker_id];
+   if(PINNING) {
+      pin_me_on(worker_cores[worker_id]);
+   } else {
+      cpu_set_t cpuset;
+      CPU_ZERO(&cpuset);
+      for(size_t i = 0; i < nodes[my_node].nb_cpus; i++)
+         CPU_SET(nodes[my_node].cpus[i], &cpuset);
+      if(pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset))
+         die("Cannot run worker %d on node %d\n", worker_id, my_node);
+   }
+   unsigned long mask = 1LU << my_node;
+   if(syscall(SYS_set_mempolicy, MPOL_PREFERRED, &mask, sizeof(mask) * 8 + 1))
+      printf("#WARNING! Cannot allocate the memory of worker %d on node %d\n", worker_id, my_node);
+}
+
+int numa_injector_core(int injector_id) {
+   if(!nb_injector_cores)
+      return worker_cores[injector_id % get_nb_workers()];
+   return injector_cores[injector_id % nb_injector_cores];
+}
+
+/* Node of the calling worker, -1 if workers are not placed */
+int numa_my_node(void) {
+   return my_node;
+}
+
+void numa_bind_memory(void *addr, size_t len, int node) {
+   unsigned long mask = 1LU << node;
+   if(syscall(SYS_mbind, addr, len, MPOL_PREFERRED, &mask, sizeof(mask) * 8 + 1, 0))
+      printf("#WARNING! Cannot bind %lu MB of memory to node %d\n", len / 1024 / 1024, node);
+}
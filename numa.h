@@ -0,0 +1,11 @@
+#ifndef NUMA_H
+#define NUMA_H 1
+
+void numa_set_disk_nodes(const char *nodes); // -n option of main, comma separated node of each disk
+void numa_init(int nb_disks, int nb_workers_per_disk);
+void numa_place_worker(int worker_id);
+int numa_injector_core(int injector_id);
+int numa_my_node(void);
+void numa_bind_memory(void *addr, size_t len, int node);
+
+#endif
@@ -3,31 +3,107 @@
 
 #define DEBUG 0
 #define PINNING 1
+#define NUMA_PLACEMENT 0 // Run each worker on the NUMA node of its disk, and allocate its page cache, callbacks and index on that node (see numa.c)
 #define PATH "/scratch%lu/kvell/slab-%d-%lu-%lu"
+#define SLAB_CLASSES_PATH "/scratch%lu/kvell/slab-classes" // Item sizes of the slabs of the database, written when the database is created
+#define MAX_SLAB_CLASSES 32
+#define MAX_SLAB_ITEM_SIZE (64LU*1024LU + PAGE_SIZE) // 64KB values, plus the header and the key of the item
+#define SLAB_CLASSES_SAMPLING 0 // N > 0: record the size of 1 in N written items and recommend slab classes after each benchmark (see slabclasses.c), 0: disabled
 
 /* In memory structures */
 #define RBTREE 0
 #define RAX 1
 #define ART 2
 #define BTREE 3
+#define HASHTABLE 4 // Page cache only, fixed capacity open-addressing hash table
 
 #define MEMORY_INDEX BTREE
 #define PAGECACHE_INDEX BTREE
 
+/* IO engine (can be changed at runtime with ./main -e aio|uring|threads) */
+#define LINUX_AIO 0
+#define IO_URING 1
+#define IO_THREADS 2 // Synchronous pread / pwrite in helper threads, for file systems on which AIO is not asynchronous
+
+#define IO_ENGINE LINUX_AIO
+#define IO_THREADS_PER_WORKER 8 // Number of helper threads of each worker with IO_THREADS
+
 /* Queue depth management */
 #define QUEUE_DEPTH 64
 #define MAX_NB_PENDING_CALLBACKS_PER_WORKER (4*QUEUE_DEPTH)
 #define NEVER_EXCEED_QUEUE_DEPTH 1 // Never submit more than QUEUE_DEPTH IO requests simultaneously, otherwise up to 2*MAX_NB_PENDING_CALLBACKS_PER_WORKER (very unlikely)
+#define ADAPTIVE_QUEUE_DEPTH 0 // Adjust the queue depth of each worker online (QUEUE_DEPTH is then the initial depth, MAX_NB_PENDING_CALLBACKS_PER_WORKER the maximum): maximize throughput while the average IO latency stays below ADAPTIVE_QD_LATENCY_CEILING_US
+#define ADAPTIVE_QD_LATENCY_CEILING_US 2000
+#define ADAPTIVE_QD_PERIOD_US 20000 // The depth is adjusted every 20ms
+#define ADAPTIVE_QD_MIN 4
 #define WAIT_A_BIT_FOR_MORE_IOS 0 // If we realize we don't have QUEUE_DEPTH IO pending when submitting IOs, check again if new incoming requests have arrived. Boost performance a tiny bit for zipfian workloads on AWS, but really not worthwhile
+#define PARTIAL_IO_COMPLETIONS 0 // Don't wait for all submitted IOs to complete: process the completed ones and keep dequeuing requests while the others are in flight. Lower tail latency when some IOs are slow (e.g., reads behind writes)
+#define MERGE_ADJACENT_IOS 0 // Requests to consecutive pages of the same file submitted together are sent as 1 vectored IO (preadv / pwritev)
+#define MAX_MERGED_IOS 32 // Maximum number of pages in a merged IO
+
+/* Scheduling of reads and writes, reads are always submitted first */
+#define IO_SCHED_FIFO 0 // Submit all the queued IOs
+#define IO_SCHED_READ_PRIORITY 1 // Only submit writes when no read is waiting (or when too many writes are waiting)
+#define IO_SCHED_WEIGHTED 2 // When reads are waiting, writes get IO_SCHED_WRITE_WEIGHT% of the submitted IOs
+#define IO_SCHED_WRITE_BUDGET 3 // When reads are waiting, submit at most IO_SCHED_MAX_WRITES_PER_BATCH writes
+#define IO_SCHEDULER IO_SCHED_FIFO
+#define IO_SCHED_WRITE_WEIGHT 25
+#define IO_SCHED_MAX_WRITES_PER_BATCH 8
 
 /* Page cache */
 //#define PAGE_CACHE_SIZE (PAGE_SIZE * 20480)
-#define PAGE_CACHE_SIZE (PAGE_SIZE * 7864320) //30GB
+#define PAGE_CACHE_SIZE (PAGE_SIZE * 7864320) //30GB -- default size, can be changed at startup (-c) and at runtime (page_cache_resize)
 //#define PAGE_CACHE_SIZE (PAGE_SIZE * 2621440) //10GB
 //#define PAGE_CACHE_SIZE (PAGE_SIZE * 786432) //3GB
 #define MAX_PAGE_CACHE (PAGE_CACHE_SIZE / PAGE_SIZE)
+#define PAGE_CACHE_MAX_SIZE PAGE_CACHE_SIZE // Memory is reserved (but not used) for the page cache to grow up to this size at runtime, e.g., (PAGE_CACHE_SIZE * 2)
+#define PAGECACHE_LRU 0 // Evict the least recently used page, pages are moved at the head of a doubly-linked list on every hit
+#define PAGECACHE_CLOCK 1 // CLOCK: a hit only sets a reference bit, eviction sweeps a hand over the pages and evicts the first non referenced one
+#define PAGECACHE_REPLACEMENT PAGECACHE_LRU
+#define PAGECACHE_ADMIT_ALL 0 // Every page that is read is cached as recently used
+#define PAGECACHE_ADMIT_SCAN_LOW_PRIORITY 1 // Pages read by scans (callback->scan) are cached with a low priority (evicted first) and scans don't bump cached pages
+#define PAGECACHE_ADMIT_TINYLFU 2 // Same, and a page is only cached with a normal priority if a frequency sketch says it is accessed more often than the page it replaces
+#define PAGECACHE_ADMISSION PAGECACHE_ADMIT_ALL
+#define HUGE_PAGES_NONE 0
+#define HUGE_PAGES_2MB 1
+#define HUGE_PAGES_1GB 2
+#define PAGECACHE_HUGE_PAGES HUGE_PAGES_NONE // HUGE_PAGES_2MB or HUGE_PAGES_1GB: back the page cache with explicit huge pages (MAP_HUGETLB, reserve them in /proc/sys/vm/nr_hugepages), falls back to transparent huge pages when none are available
+#define PAGECACHE_LAZY_INIT 0 // Don't fault the memory of the page cache at startup, it is faulted when pages are first used (fast restarts)
+#define PAGECACHE_PREFAULT_IN_BACKGROUND 1 // With PAGECACHE_LAZY_INIT, fault the memory of the page cache in a background thread once the workers are ready
+#define PAGECACHE_PREFAULT_CHUNK (64LU*1024*1024)
+#define SHARED_PAGE_CACHE 0 // Workers start with 1/nb_workers of the page cache, and capacity is periodically moved from the workers that miss the least to the ones that miss the most
+#define SHARED_PAGE_CACHE_MAX_SHARE 4 // A worker can grow up to 4x its share of PAGE_CACHE_MAX_SIZE
+#define SHARED_PAGE_CACHE_REBALANCE_US 50000
+#define SHARED_PAGE_CACHE_MIN_MISSES 64 // Don't rebalance when workers barely miss (e.g., idle)
+#define PAGE_CACHE_RELEASE_BATCH 8 // Pages given back per access by a worker whose share of the page cache has been reduced
+#define WRITE_BACK_CACHE 0 // Writes only modify the page cache, dirty pages are flushed after WRITE_BACK_DELAY_US or when a worker has more than WRITE_BACK_MAX_DIRTY_PAGES dirty pages. Requests are acknowledged before or after the flush depending on callback->ack
+#define WRITE_BACK_DELAY_US 1000
+#define WRITE_BACK_MAX_DIRTY_PAGES 1024
+#define ITEM_CACHE 0 // Also cache hot items smaller than ITEM_CACHE_MAX_ITEM_SIZE in a compact per-worker arena, so that a hot 100B item doesn't need a 4KB page in the page cache
+#define ITEM_CACHE_SIZE (PAGE_CACHE_SIZE / 8) // in addition to PAGE_CACHE_SIZE, split between workers
+#define ITEM_CACHE_MAX_ITEM_SIZE 1024
+#define ITEM_CACHE_CHUNK_SIZE (64LU*1024LU)
+#define COMPRESSED_CACHE 0 // Keep the clean pages evicted from the page cache compressed in memory, a miss of the page cache looks there before reading from disk
+#define COMPRESSED_CACHE_SIZE (PAGE_CACHE_SIZE / 4) // in addition to PAGE_CACHE_SIZE, split between workers
+#define LARGE_ITEMS_CACHE_SIZE (PAGE_SIZE * 65536) // 256MB per slab class of items bigger than a page, these items are cached in a page cache of their own (in addition to PAGE_CACHE_SIZE)
+
+/* Memory allocation */
+#define OBJECT_POOLS 0 // Callbacks, items and IO engine metadata are allocated from per-thread pools of cache-line aligned objects instead of malloc (0 = malloc, e.g., to compare with TCMalloc)
+#define POOL_CHUNK_SIZE (1024LU*1024LU) // Pools allocate objects by chunks of 1MB
 
 /* Free list */
 #define FREELIST_IN_MEMORY_ITEMS (256) // We need enough to never have to read from disk
 
+/* Slab files */
+#define SLAB_BACKGROUND_EXTENSION 0 // Slab files are extended by a background thread before they are full, so that workers don't wait for fallocate (see slab.c)
+#define SLAB_EXTENSION_WATERMARK 25 // Extend a slab when less than 25% of its spots have never been used...
+#define SLAB_EXTENSION_MIN_FREE (1024LU*1024LU) // ... or less than 1MB, so that small slabs that grow fast are extended far enough ahead
+
+/* Compaction */
+#define SLAB_COMPACTION 0 // Workers move the items at the end of sparse slabs to free spots and truncate the files, in the background (see compaction.c)
+#define COMPACTION_MIN_FREE_PERCENT 25 // Compact slabs in which at least 25% of the spots are free...
+#define COMPACTION_MIN_FREE_PAGES 256 // ... and that many pages could be reclaimed
+#define COMPACTION_IOS_PER_SEC 2000 // Page reads and writes per second of the compaction of a worker
+#define SLAB_CLUSTERING 0 // Move the items in key order in the slabs once the database is loaded, so that scans read fewer pages (see compaction.c)
+
 #endif
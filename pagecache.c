@@ -14,31 +14,401 @@
  * The lru entry is used to have a lru order of cached content + some metadata.
  * lru_entry.dirty = the page has been written but not flushed
  * lru_entry.contains_data = the page already contains the correct content, no need to read page from disk
+ * lru_entry.referenced = CLOCK reference bit, managed by the page cache
+ * lru_entry.queued_writes / completed_writes = number of writes of the page sent to / completed by the disk
+ * lru_entry.dirty_since = with the write-back cache, the page has been modified but the write hasn't been queued yet (the page is never evicted)
  * These metadata are cleared by the page cache and set by the IO engine.
  *
+ * Two replacement policies (PAGECACHE_REPLACEMENT):
+ *  - LRU: pages are kept in a doubly-linked list, a hit moves the page at the head of the list and the tail is evicted.
+ *  - CLOCK: a hit only sets the reference bit of the page. To evict a page, a hand sweeps over the used_pages array, clearing the reference bits,
+ *    until it finds a page that has not been referenced since the previous sweep. Hits do not touch the metadata of other pages.
+ * Newly cached pages are considered recently used by both policies. Pages that are being read or written are never evicted.
+ *
+ * Admission (PAGECACHE_ADMISSION): a page has to be cached to be read, but pages that are not worth caching are cached with a low priority,
+ * i.e., at the tail of the list with LRU, and not referenced and in a FIFO of pages to evict first with CLOCK. Pages read by scans are cached with
+ * a low priority and scans don't bump the pages they hit, so that long scans of cold pages don't evict the working set of point queries.
+ * With TinyLFU, a count-min sketch approximates the access frequency of pages, and a missed page is cached with a low priority if it
+ * has been accessed less often than the page it replaces.
+ *
+ * Clean pages evicted from the page cache of a worker can be kept compressed in a second tier (COMPRESSED_CACHE, see compressedcache.c),
+ * a miss looks in the compressed cache before the page is read from disk.
+ *
+ * Pages are PAGE_SIZE bytes, except in the page caches of slabs of items bigger than a page where a "page" contains a full item.
+ *
+ * Each worker owns its page cache (no locking on the fast path), but the capacity of the page caches of the workers (max_pages) is a quota
+ * that can be changed at runtime: the page cache can be resized, and shared (SHARED_PAGE_CACHE) in which case quota is moved from the
+ * workers that miss the least to the workers that miss the most. Memory is reserved, but only faulted when used, for up to capacity pages.
+ * When its quota decreases, a worker gives pages back to the kernel (the pages are marked "released" and kept in a free list).
+ *
+ * The memory of the page cache is not touched when it is initialized (PAGECACHE_LAZY_INIT): it comes from anonymous mappings, which are zero
+ * filled by the kernel when pages are first accessed, i.e., when used_page_size grows. So workers are ready as soon as their index is rebuilt.
+ * Once all workers are ready, the memory can be faulted by a background thread (page_cache_prefault) to avoid page faults on the first misses.
+ *
+ * The cached data and the lru entries can be backed by huge pages (PAGECACHE_HUGE_PAGES) to avoid TLB misses on random accesses.
+ * Explicit huge pages are tried first, then transparent huge pages (madvise), the result is printed when the page cache is initialized.
+ *
  * The page cache shouldn't be used directly, the interface of the IO engine is a more convenient way to access data.
  */
 
-void page_cache_init(struct pagecache *p) {
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#define HUGE_PAGE_SIZE(huge_pages) ((huge_pages == HUGE_PAGES_1GB)?(1LU<<30):(1LU<<21))
+
+/*
+ * Allocate zeroed memory, backed by huge pages if possible. *backing describes what has been obtained.
+ * Only used bytes of the memory will be used until the page cache is resized, explicit huge pages are only used when used == size (they are
+ * reserved when the memory is mapped). The used bytes are faulted now if populate is set, otherwise the memory is faulted on first access.
+ */
+static void *page_cache_alloc(size_t size, size_t used, int populate, const char **backing) {
+   void *data;
+   if(PAGECACHE_HUGE_PAGES == HUGE_PAGES_NONE || size < HUGE_PAGE_SIZE(PAGECACHE_HUGE_PAGES)) { // small allocations would waste most of a huge page
+      data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+      assert(data != MAP_FAILED); // If it fails here, it's probably because page cache size is bigger than RAM -- see options.h
+      if(populate)
+         memset(data, 0, used);
+      *backing = "4KB pages";
+      return data;
+   }
+
+   size_t huge_page_size = HUGE_PAGE_SIZE(PAGECACHE_HUGE_PAGES);
+   int all_used = (used >= size); // compared before rounding, sizes are rarely a multiple of the huge page size
+   size = (size + huge_page_size - 1) / huge_page_size * huge_page_size;
+
+   int huge_shift = (PAGECACHE_HUGE_PAGES == HUGE_PAGES_1GB)?30:21;
+   if(all_used) {
+      data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (populate?MAP_POPULATE:0) | (huge_shift << MAP_HUGE_SHIFT), -1, 0);
+      if(data != MAP_FAILED) {
+         *backing = (PAGECACHE_HUGE_PAGES == HUGE_PAGES_1GB)?"explicit 1GB huge pages":"explicit 2MB huge pages";
+         return data;
+      }
+   }
+
+   // Not enough reserved huge pages, ask for transparent huge pages (the mapping is aligned so that the kernel can use them)
+   char *map = mmap(NULL, size + huge_page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+   assert(map != MAP_FAILED); // If it fails here, it's probably because page cache size is bigger than RAM -- see options.h
+   data = (void*)(((uint64_t)map + huge_page_size - 1) / huge_page_size * huge_page_size);
+   if(madvise(data, size, MADV_HUGEPAGE) == 0)
+      *backing = "transparent huge pages";
+   else
+      *backing = "4KB pages (transparent huge pages are disabled)";
+   if(populate)
+      memset(data, 0, used); // fault the memory now
+   return data;
+}
+
+/*
+ * TinyLFU frequency sketch: a count-min sketch of 4 rows of 4-bit saturating counters (stored in bytes) approximates how often pages are
+ * accessed. Counters are halved every SKETCH_SAMPLES_PER_PAGE accesses per page of the cache so that old accesses are forgotten.
+ */
+#define SKETCH_ROWS 4
+#define SKETCH_MAX_COUNT 15
+#define SKETCH_SAMPLES_PER_PAGE 10
+struct frequency_sketch {
+   uint8_t *counters;
+   size_t mask;                        // SKETCH_ROWS rows of mask + 1 counters
+   size_t nb_samples, max_samples;
+};
+
+static struct frequency_sketch *sketch_create(size_t nb_pages) {
+   struct frequency_sketch *s = calloc(1, sizeof(*s));
+   size_t width = 1;
+   while(width < nb_pages)
+      width *= 2;
+   s->counters = calloc(SKETCH_ROWS * width, sizeof(*s->counters));
+   s->mask = width - 1;
+   s->max_samples = SKETCH_SAMPLES_PER_PAGE * nb_pages;
+   return s;
+}
+
+static uint64_t sketch_hash(uint64_t hash) { // murmur3 finalizer, consecutive pages of a file must not collide
+   hash ^= hash >> 33;
+   hash *= 0xff51afd7ed558ccdLU;
+   hash ^= hash >> 33;
+   hash *= 0xc4ceb9fe1a85ec53LU;
+   hash ^= hash >> 33;
+   return hash;
+}
+
+static size_t sketch_frequency(struct frequency_sketch *s, uint64_t hash) {
+   uint64_t h = sketch_hash(hash);
+   size_t freq = SKETCH_MAX_COUNT;
+   for(size_t i = 0; i < SKETCH_ROWS; i++) {
+      uint8_t c = s->counters[i * (s->mask + 1) + ((h + i * (h >> 32)) & s->mask)];
+      if(c < freq)
+         freq = c;
+   }
+   return freq;
+}
+
+static void sketch_increment(struct frequency_sketch *s, uint64_t hash) {
+   uint64_t h = sketch_hash(hash);
+   for(size_t i = 0; i < SKETCH_ROWS; i++) {
+      uint8_t *c = &s->counters[i * (s->mask + 1) + ((h + i * (h >> 32)) & s->mask)];
+      if(*c < SKETCH_MAX_COUNT)
+         (*c)++;
+   }
+   s->nb_samples++;
+   if(s->nb_samples == s->max_samples) {
+      for(size_t i = 0; i < SKETCH_ROWS * (s->mask + 1); i++)
+         s->counters[i] /= 2;
+      s->nb_samples /= 2;
+   }
+}
+
+/* Initialize a page cache of cache_size bytes that can grow up to max_cache_size bytes */
+static void _page_cache_init(struct pagecache *p, size_t page_size, size_t cache_size, size_t max_cache_size) {
    declare_timer;
+   const char *data_backing, *lru_backing;
+   p->page_size = page_size;
+   p->max_pages = cache_size / page_size;
+   p->target_pages = p->max_pages;
+   p->min_pages = 1;
+   p->capacity = max_cache_size / page_size;
    start_timer {
       printf("#Reserving memory for page cache...\n");
-      p->cached_data = aligned_alloc(PAGE_SIZE, PAGE_CACHE_SIZE/get_nb_workers());
-      assert(p->cached_data); // If it fails here, it's probably because page cache size is bigger than RAM -- see options.h
-      memset(p->cached_data, 0, PAGE_CACHE_SIZE/get_nb_workers());
-   } stop_timer("Page cache initialization");
+      p->cached_data = page_cache_alloc(p->capacity * p->page_size, p->max_pages * p->page_size, !PAGECACHE_LAZY_INIT, &data_backing);
+      p->used_pages = page_cache_alloc(p->capacity * sizeof(*p->used_pages), p->capacity * sizeof(*p->used_pages), !PAGECACHE_LAZY_INIT, &lru_backing);
+   } stop_timer("Page cache initialization (%lu MB of data backed by %s, lru entries backed by %s%s)", p->max_pages * p->page_size / 1024 / 1024, data_backing, lru_backing, PAGECACHE_LAZY_INIT?", faulted on first use":"");
 
-   p->hash_to_page = tree_create();
-   p->used_pages = calloc(MAX_PAGE_CACHE/get_nb_workers(), sizeof(*p->used_pages));
+   p->hash_to_page = tree_create(p->capacity); // the quota never exceeds the capacity
    p->used_page_size = 0;
+   p->nb_pages = 0;
+   p->free_pages = NULL;
+   p->compressed = NULL;
+   p->sketch = NULL;
+   p->probation = NULL;
+   p->probation_size = 0;
+   p->probation_head = 0;
+   p->probation_tail = 0;
+   p->clock_hand = 0;
    p->oldest_page = NULL;
    p->newest_page = NULL;
+   page_cache_set_policies(p, PAGECACHE_REPLACEMENT, PAGECACHE_ADMISSION);
+}
+
+/* Choose the replacement and admission policies of a page cache, the TinyLFU sketch and the CLOCK probation FIFO are only allocated when used */
+void page_cache_set_policies(struct pagecache *p, int replacement, int admission) {
+   p->replacement = replacement;
+   p->admission = admission;
+   if(admission == PAGECACHE_ADMIT_TINYLFU && !p->sketch)
+      p->sketch = sketch_create(p->capacity);
+   if(replacement == PAGECACHE_CLOCK && !p->probation) {
+      p->probation_size = p->capacity / 16 + 1;
+      p->probation = calloc(p->probation_size, sizeof(*p->probation));
+   }
+}
+
+void page_cache_init(struct pagecache *p, size_t page_size, size_t cache_size) {
+   _page_cache_init(p, page_size, cache_size, cache_size);
+}
+
+static int release_page(struct pagecache *p);
+
+/*
+ * Page caches of the workers.
+ * The size of the page cache is the sum of the quotas (max_pages) of the page caches of the workers. It is PAGE_CACHE_SIZE by default
+ * and can be changed before the workers are launched (-c option of main) or while they run (page_cache_resize). Resizing scales the quota
+ * of every worker, a worker whose quota decreases gives pages back to the kernel on its next accesses or when it is idle (dirty pages are
+ * flushed first because the IO engine never lets more than half of the quota be dirty).
+ *
+ * The quotas are only modified by the worker that owns the cache: resizing and rebalancing publish a new quota (target_pages) that the
+ * worker adopts in page_cache_release_pages.
+ *
+ * With SHARED_PAGE_CACHE, the rebalancer runs every SHARED_PAGE_CACHE_REBALANCE_US in the worker that grabs the lock first. It moves a
+ * step of quota from the cache with the fewest misses since the last rebalancing to the cache with the most misses. The cache that misses
+ * the most only gets pages that have already been given back, so that the page caches never use more than the size of the page cache.
+ */
+static struct pagecache **worker_caches;
+static size_t nb_worker_caches;
+static size_t total_pages = PAGE_CACHE_SIZE / PAGE_SIZE;
+static size_t max_total_pages = PAGE_CACHE_MAX_SIZE / PAGE_SIZE; // memory is reserved for the page cache to grow up to max(PAGE_CACHE_MAX_SIZE, initial size)
+static volatile uint64_t last_rebalance;
+static pthread_mutex_t worker_caches_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Initialize the page cache of a worker, the page cache is split evenly between the workers.
+ * The quota of a worker never goes below the pages that cannot be evicted: the max_pending_io pages being read or written by the IO engine
+ * and the dirty pages, which may be half of the quota (see write_back_page in ioengine.c). Otherwise no page could be evicted.
+ */
+void page_cache_init_worker(struct pagecache *p, size_t nb_workers, size_t max_pending_io) {
+   size_t min_pages = 2 * max_pending_io + 2;
+
+   pthread_mutex_lock(&worker_caches_lock);
+   if(max_total_pages < total_pages)
+      max_total_pages = total_pages;
+   size_t max_pages = max_total_pages / nb_workers;
+   if(SHARED_PAGE_CACHE) { // the worker may get the share of other workers, but the rebalancer leaves them at least a quarter of their share
+      size_t max_rebalanced = max_total_pages - (nb_workers - 1) * (max_total_pages / nb_workers / 4);
+      max_pages *= SHARED_PAGE_CACHE_MAX_SHARE;
+      if(max_pages > max_rebalanced)
+         max_pages = max_rebalanced;
+   }
+   size_t pages = total_pages / nb_workers;
+   pthread_mutex_unlock(&worker_caches_lock);
+
+   if(pages < min_pages) {
+      printf("#WARNING! The page cache of a worker needs at least %lu pages (%lu IOs in flight and dirty pages), using %lu pages instead of %lu\n", min_pages, max_pending_io, min_pages, pages);
+      pages = min_pages;
+   }
+   if(max_pages < pages)
+      max_pages = pages;
+   _page_cache_init(p, PAGE_SIZE, pages * PAGE_SIZE, max_pages * PAGE_SIZE);
+   p->min_pages = min_pages;
+   if(COMPRESSED_CACHE)
+      p->compressed = compressed_cache_init(COMPRESSED_CACHE_SIZE / nb_workers);
+   if(NUMA_PLACEMENT && numa_my_node() >= 0) { // the memory is faulted lazily, maybe by another thread, so it doesn't follow the policy of the worker
+      numa_bind_memory(p->cached_data, p->capacity * p->page_size, numa_my_node());
+      numa_bind_memory(p->used_pages, p->capacity * sizeof(*p->used_pages), numa_my_node());
+   }
+
+   pthread_mutex_lock(&worker_caches_lock);
+   worker_caches = realloc(worker_caches, (nb_worker_caches + 1) * sizeof(*worker_caches));
+   worker_caches[nb_worker_caches++] = p;
+   pthread_mutex_unlock(&worker_caches_lock);
+}
+
+size_t page_cache_size(void) {
+   return total_pages * PAGE_SIZE;
+}
+
+void page_cache_resize(size_t cache_size) {
+   size_t new_total = cache_size / PAGE_SIZE;
+
+   pthread_mutex_lock(&worker_caches_lock);
+   if(nb_worker_caches && new_total > max_total_pages) {
+      printf("#WARNING! Cannot grow the page cache to %lu MB, memory has only been reserved for %lu MB (see PAGE_CACHE_MAX_SIZE)\n", cache_size / 1024 / 1024, max_total_pages * PAGE_SIZE / 1024 / 1024);
+      new_total = max_total_pages;
+   }
+   for(size_t i = 0; i < nb_worker_caches; i++) {
+      struct pagecache *p = worker_caches[i];
+      size_t quota = p->target_pages * new_total / total_pages;
+      if(quota > p->capacity)
+         quota = p->capacity;
+      if(quota < p->min_pages)
+         quota = p->min_pages;
+      __atomic_store_n(&p->target_pages, quota, __ATOMIC_RELEASE);
+   }
+   total_pages = new_total;
+   pthread_mutex_unlock(&worker_caches_lock);
+}
+
+/*
+ * Fault the memory of the page caches of the workers up to their quota, without modifying it: MADV_POPULATE_WRITE only faults pages that
+ * are not mapped yet, so the thread can run while workers use their page cache. Memory is faulted by chunks of PAGECACHE_PREFAULT_CHUNK
+ * bytes so that the page faults of workers do not wait for a long madvise.
+ */
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23
+#endif
+static int prefault(char *data, size_t size) {
+   for(size_t off = 0; off < size; off += PAGECACHE_PREFAULT_CHUNK) {
+      size_t len = (size - off < PAGECACHE_PREFAULT_CHUNK)?(size - off):PAGECACHE_PREFAULT_CHUNK;
+      if(madvise(data + off, len, MADV_POPULATE_WRITE))
+         return -1;
+   }
+   return 0;
+}
+
+static void *page_cache_prefault_thread(void *pdata) {
+   declare_timer;
+   size_t nb_pages = 0;
+   start_timer {
+      for(size_t i = 0; i < nb_worker_caches; i++) {
+         struct pagecache *p = worker_caches[i];
+         size_t pages = __atomic_load_n(&p->target_pages, __ATOMIC_ACQUIRE); // the quota may change while we prefault, memory that is released again is given back on the next resize
+         if(prefault(p->cached_data, pages * p->page_size) || prefault((char*)p->used_pages, pages * sizeof(*p->used_pages))) {
+            printf("#WARNING! Cannot prefault the page cache (MADV_POPULATE_WRITE needs Linux 5.14), it will be faulted on first use\n");
+            return NULL;
+         }
+         nb_pages += pages;
+      }
+   } stop_timer("Page cache prefaulted in the background (%lu MB)", nb_pages * PAGE_SIZE / 1024 / 1024);
+   return NULL;
+}
+
+/* Called once all the workers are ready */
+void page_cache_prefault(void) {
+   pthread_t t;
+   pthread_create(&t, NULL, page_cache_prefault_thread, NULL);
+   pthread_detach(t);
+}
+
+/*
+ * Adopt the quota published by page_cache_resize or page_cache_rebalance, and if it has been reduced, give a few pages back (called on every
+ * access and by idle workers). Stops when all the remaining pages are busy or dirty, they are given back once their IOs complete.
+ */
+void page_cache_release_pages(struct pagecache *p) {
+   p->max_pages = __atomic_load_n(&p->target_pages, __ATOMIC_ACQUIRE);
+   for(size_t i = 0; i < PAGE_CACHE_RELEASE_BATCH && p->nb_pages > p->max_pages; i++)
+      if(!release_page(p))
+         break;
+}
+
+void page_cache_rebalance(void) {
+   uint64_t now;
+   rdtscll(now);
+   if(cycles_to_us(now - last_rebalance) < SHARED_PAGE_CACHE_REBALANCE_US)
+      return;
+   if(pthread_mutex_trylock(&worker_caches_lock))
+      return; // another worker is rebalancing
+   if(cycles_to_us(now - last_rebalance) < SHARED_PAGE_CACHE_REBALANCE_US)
+      goto end;
+   last_rebalance = now;
+
+   size_t rebalance_step = total_pages / nb_worker_caches / 32;
+   size_t min_pages = total_pages / nb_worker_caches / 4;
+   size_t used_pages = 0; // pages that are cached or that a cache is allowed to use
+   struct pagecache *donor = NULL, *receiver = NULL;
+   size_t donor_misses = 0, receiver_misses = 0;
+   for(size_t i = 0; i < nb_worker_caches; i++) {
+      struct pagecache *p = worker_caches[i];
+      size_t misses = __atomic_load_n(&p->misses, __ATOMIC_RELAXED) - p->rebalanced_misses;
+      size_t nb_pages = __atomic_load_n(&p->nb_pages, __ATOMIC_RELAXED);
+      p->rebalanced_misses += misses;
+      used_pages += (nb_pages > p->target_pages)?nb_pages:p->target_pages;
+      if(p->target_pages >= min_pages + rebalance_step && p->target_pages >= p->min_pages + rebalance_step && (!donor || misses < donor_misses)) {
+         donor = p;
+         donor_misses = misses;
+      }
+      if(p->target_pages < p->capacity && (!receiver || misses > receiver_misses)) {
+         receiver = p;
+         receiver_misses = misses;
+      }
+   }
+   if(!receiver || receiver_misses < SHARED_PAGE_CACHE_MIN_MISSES)
+      goto end;
+
+   // Pages that have been given back go to the cache that needs them the most
+   if(used_pages < total_pages) {
+      size_t free_pages = total_pages - used_pages;
+      if(free_pages > receiver->capacity - receiver->target_pages)
+         free_pages = receiver->capacity - receiver->target_pages;
+      __atomic_store_n(&receiver->target_pages, receiver->target_pages + free_pages, __ATOMIC_RELEASE);
+   }
+
+   // And the cache that misses the least will give a few pages back on its next accesses
+   if(donor && donor != receiver && receiver_misses > donor_misses + donor_misses / 4)
+      __atomic_store_n(&donor->target_pages, donor->target_pages - rebalance_step, __ATOMIC_RELEASE);
+
+end:
+   pthread_mutex_unlock(&worker_caches_lock);
+}
+
+static void unlink_page_from_lru(struct pagecache *p, struct lru *me) {
+   if(p->oldest_page == me)
+      p->oldest_page = me->prev;
+   if(p->newest_page == me)
+      p->newest_page = me->next;
+   if(me->prev)
+      me->prev->next = me->next;
+   if(me->next)
+      me->next->prev = me->prev;
 }
 
-struct lru *add_page_in_lru(struct pagecache *p, void *page, uint64_t hash) {
-   struct lru *me = &p->used_pages[p->used_page_size];
+struct lru *add_page_in_lru(struct pagecache *p, struct lru *me, uint64_t hash) {
    me->hash = hash;
-   me->page = page;
    if(!p->oldest_page)
       p->oldest_page = me;
    me->prev = NULL;
@@ -65,16 +435,155 @@ void bump_page_in_lru(struct pagecache *p, struct lru *me, uint64_t hash) {
    p->newest_page = me;
 }
 
+/* Low priority pages are put at the tail of the LRU list, they are the next ones to be evicted */
+static void demote_page_in_lru(struct pagecache *p, struct lru *me) {
+   if(me == p->oldest_page)
+      return;
+   unlink_page_from_lru(p, me);
+   me->next = NULL;
+   me->prev = p->oldest_page;
+   p->oldest_page->next = me;
+   p->oldest_page = me;
+}
+
+/* Pages that are being read or written cannot be evicted (there are at most a queue depth of them) */
+static int page_is_busy(struct lru *me) {
+   return !me->contains_data || me->queued_writes != me->completed_writes;
+}
+
+/* CLOCK: find the page to evict, NULL if the hand went twice around the clock without finding one (all pages are busy or dirty) */
+static struct lru *clock_evict(struct pagecache *p) {
+   for(size_t i = 0; i < 2 * p->used_page_size; i++) {
+      struct lru *me = &p->used_pages[p->clock_hand];
+      p->clock_hand++;
+      if(p->clock_hand >= p->used_page_size)
+         p->clock_hand = 0;
+      if(me->released)
+         continue;
+      if(me->dirty_since) // not flushed yet, keep it (the IO engine never lets more than half of the pages be dirty)
+         continue;
+      if(page_is_busy(me))
+         continue;
+      if(me->referenced) {
+         me->referenced = 0;
+         continue;
+      }
+      return me;
+   }
+   return NULL;
+}
+
+/*
+ * CLOCK: low priority pages are also remembered in a FIFO, so that they are evicted before the hand reaches them.
+ * Entries of pages that have been referenced or evicted since they were added are skipped.
+ */
+static void probation_add(struct pagecache *p, struct lru *me) {
+   struct probation_entry *e = &p->probation[p->probation_tail % p->probation_size];
+   e->lru = me;
+   e->hash = me->hash;
+   p->probation_tail++;
+   if(p->probation_tail - p->probation_head > p->probation_size) // full, forget the oldest page, the hand will evict it
+      p->probation_head++;
+}
+
+static struct lru *probation_evict(struct pagecache *p) {
+   while(p->probation_head != p->probation_tail) {
+      struct probation_entry *e = &p->probation[p->probation_head % p->probation_size];
+      struct lru *me = e->lru;
+      if(me->hash != e->hash || me->referenced || me->released) { // not a low priority page anymore
+         p->probation_head++;
+         continue;
+      }
+      if(me->dirty_since || page_is_busy(me)) // still being read, let the hand choose
+         return NULL;
+      p->probation_head++;
+      return me;
+   }
+   return NULL;
+}
+
+/*
+ * Choose the page to evict and remove it from the index (with LRU the page stays in the list).
+ * Returns NULL if no page can be evicted, i.e., all pages are being read, written or are dirty.
+ */
+static struct lru *evict_page(struct pagecache *p, pagecache_entry_t **old_entry) {
+   struct lru *victim;
+   int low_priority = 0;
+   if(p->replacement == PAGECACHE_CLOCK) {
+      victim = probation_evict(p);
+      low_priority = (victim != NULL);
+      if(!victim)
+         victim = clock_evict(p);
+   } else {
+      for(size_t i = 0; i < p->nb_pages && p->oldest_page->dirty_since; i++) // not flushed yet, keep it (the IO engine never lets more than half of the pages be dirty)
+         bump_page_in_lru(p, p->oldest_page, p->oldest_page->hash);
+      victim = p->oldest_page;
+      while(victim && (victim->dirty_since || page_is_busy(victim))) // don't move busy pages, low priority pages would be promoted
+         victim = victim->prev;
+   }
+   if(!victim)
+      return NULL;
+   tree_delete(p->hash_to_page, victim->hash, old_entry);
+   if(p->compressed && victim->contains_data && !low_priority) // evicted pages are clean, pages of scans are not worth keeping
+      compressed_cache_add(p->compressed, victim->hash, victim->page);
+   return victim;
+}
+
+/* Take a page that is not used yet, a released one if possible */
+static struct lru *new_page(struct pagecache *p, uint64_t hash) {
+   struct lru *me;
+   if(p->free_pages) {
+      me = p->free_pages;
+      p->free_pages = me->next;
+      me->released = 0;
+   } else {
+      assert(p->used_page_size < p->capacity);
+      me = &p->used_pages[p->used_page_size];
+      me->page = &p->cached_data[p->page_size*p->used_page_size];
+      p->used_page_size++;
+   }
+   if(p->replacement == PAGECACHE_LRU)
+      add_page_in_lru(p, me, hash);
+   __atomic_store_n(&p->nb_pages, p->nb_pages + 1, __ATOMIC_RELAXED); // read by the rebalancer
+   return me;
+}
+
+/* The quota of the page cache has been reduced, evict a page and give its memory back to the kernel. Returns 0 if no page can be evicted. */
+static int release_page(struct pagecache *p) {
+   pagecache_entry_t *old_entry = NULL;
+   struct lru *me = evict_page(p, &old_entry);
+   if(!me)
+      return 0;
+   free(old_entry); // only allocated by the RAX and ART indexes
+   if(p->replacement == PAGECACHE_LRU)
+      unlink_page_from_lru(p, me);
+   madvise(me->page, p->page_size, MADV_DONTNEED);
+   me->released = 1;
+   me->next = p->free_pages;
+   p->free_pages = me;
+   __atomic_store_n(&p->nb_pages, p->nb_pages - 1, __ATOMIC_RELAXED);
+   return 1;
+}
+
 /*
  * Get a page from the page cache.
  * *page will be set to the address in the page cache
+ * scan = the page is accessed by a scan, if it is not cached it is cached with a low priority (see PAGECACHE_ADMISSION)
  * @return 1 if the page already contains the right data, 0 otherwise.
  */
-int get_page(struct pagecache *p, uint64_t hash, void **page, struct lru **lru) {
+int get_page(struct pagecache *p, uint64_t hash, int scan, void **page, struct lru **lru) {
    void *dst;
    struct lru *lru_entry;
    maybe_unused pagecache_entry_t tmp_entry;
    maybe_unused pagecache_entry_t *old_entry = NULL;
+   int low_priority = scan && p->admission != PAGECACHE_ADMIT_ALL;
+
+   // The page cache has been shrunk, give a few pages back
+   page_cache_release_pages(p);
+
+   // Pages read by scans are not counted, they would look as frequently accessed as the pages of point queries
+   if(p->admission == PAGECACHE_ADMIT_TINYLFU && !scan)
+      sketch_increment(p->sketch, hash);
 
    // Is the page already cached?
    pagecache_entry_t *e = tree_lookup(p->hash_to_page, hash);
@@ -83,7 +592,13 @@ int get_page(struct pagecache *p, uint64_t hash, void **page, struct lru **lru)
       lru_entry = e->lru;
       if(lru_entry->hash != hash)
          die("LRU wierdness %lu vs %lu\n", lru_entry->hash, hash);
-      bump_page_in_lru(p, lru_entry, hash);
+      if(p->replacement == PAGECACHE_CLOCK) {
+         if(!lru_entry->referenced && !low_priority) // don't dirty the cache line of the hottest pages
+            lru_entry->referenced = 1;
+      } else if(!low_priority) {
+         bump_page_in_lru(p, lru_entry, hash);
+      }
+      p->hits++;
       *page = dst;
       *lru = lru_entry;
       return 1;
@@ -91,26 +606,43 @@ int get_page(struct pagecache *p, uint64_t hash, void **page, struct lru **lru)
 
 
    // Otherwise allocate a new page, either a free one, or reuse the oldest
-   if(p->used_page_size < MAX_PAGE_CACHE/get_nb_workers()) {
-      dst = &p->cached_data[PAGE_SIZE*p->used_page_size];
-      lru_entry = add_page_in_lru(p, dst, hash);
-      p->used_page_size++;
+   __atomic_store_n(&p->misses, p->misses + 1, __ATOMIC_RELAXED); // read by the rebalancer
+   lru_entry = NULL;
+   if(p->nb_pages >= p->max_pages) {
+      lru_entry = evict_page(p, &old_entry);
+      // Nothing can be evicted (the quota has just been reduced below the pages in flight), exceed the quota until pages can be given back
+      if(!lru_entry && !p->free_pages && p->used_page_size == p->capacity)
+         die("All the %lu pages of the page cache are being read, written or are dirty, the page cache is too small\n", p->nb_pages);
+   }
+   if(!lru_entry) {
+      lru_entry = new_page(p, hash);
    } else {
-      lru_entry = p->oldest_page;
-      dst = p->oldest_page->page;
-
-      tree_delete(p->hash_to_page, p->oldest_page->hash, &old_entry);
-
-      lru_entry->hash = hash;
-      lru_entry->page = dst;
-      bump_page_in_lru(p, lru_entry, hash);
+      // TinyLFU: the page is only admitted with a normal priority if it is accessed more often than the page it replaces
+      if(p->admission == PAGECACHE_ADMIT_TINYLFU && sketch_frequency(p->sketch, hash) < sketch_frequency(p->sketch, lru_entry->hash))
+         low_priority = 1;
+      if(p->replacement == PAGECACHE_LRU && !low_priority) {
+         lru_entry->hash = hash;
+         bump_page_in_lru(p, lru_entry, hash);
+      }
    }
+   dst = lru_entry->page;
+   if(low_priority && p->replacement == PAGECACHE_LRU)
+      demote_page_in_lru(p, lru_entry);
 
    // Remember that the page cache now stores this hash
+   lru_entry->hash = hash;
+   lru_entry->referenced = !low_priority;
    tree_insert(p->hash_to_page, hash, old_entry, dst, lru_entry);
+   if(low_priority && p->replacement == PAGECACHE_CLOCK)
+      probation_add(p, lru_entry);
 
    lru_entry->contains_data = 0;
    lru_entry->dirty = 0; // should already be equal to 0, but we never know
+   lru_entry->queued_writes = 0;
+   lru_entry->completed_writes = 0;
+   lru_entry->dirty_since = 0;
+   if(p->compressed && compressed_cache_get(p->compressed, hash, dst)) // no need to read the page from disk
+      lru_entry->contains_data = 1;
    *page = dst;
    *lru = lru_entry;
 
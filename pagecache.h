@@ -7,7 +7,7 @@ typedef struct index_entry pagecache_entry_t;
 
 #include "indexes/rbtree.h"
 typedef rbtree hash_t;
-#define tree_create() rbtree_create()
+#define tree_create(max_entries) rbtree_create()
 #define tree_lookup(h, hash) rbtree_lookup((h), (void*)(hash), pointer_cmp)
 #define tree_delete(h, hash, old_entry)  rbtree_delete((h), (void*)(hash), pointer_cmp);
 #define tree_insert(h, hash, old_entry, dst, lru_entry) \
@@ -20,7 +20,7 @@ typedef rbtree hash_t;
 
 #include "indexes/rax.h"
 typedef rax* hash_t;
-#define tree_create() raxNew()
+#define tree_create(max_entries) raxNew()
 #define tree_lookup(h, hash) ({ void *__v = raxFind((h), (unsigned char*)&(hash), sizeof(hash)); __v==raxNotFound?NULL:__v; })
 #define tree_delete(h, hash, old_entry) raxRemove((h), (unsigned char *)&(hash), sizeof(hash), (void**)(old_entry))
 #define tree_insert(h, hash, old_entry, dst, lru_entry) \
@@ -37,7 +37,7 @@ typedef rax* hash_t;
 
 #include "indexes/art.h"
 typedef art_tree* hash_t;
-#define tree_create() ({ art_tree *___t = malloc(sizeof(*___t)); art_tree_init(___t); ___t; })
+#define tree_create(max_entries) ({ art_tree *___t = malloc(sizeof(*___t)); art_tree_init(___t); ___t; })
 #define tree_lookup(h, hash) art_search((h), (unsigned char*)&(hash), sizeof(hash))
 #define tree_delete(h, hash, old_entry) *old_entry = art_delete((h), (unsigned char *)&(hash), sizeof(hash))
 #define tree_insert(h, hash, old_entry, dst, lru_entry) \
@@ -54,7 +54,7 @@ typedef art_tree* hash_t;
 
 #include "indexes/btree.h"
 typedef btree_t* hash_t;
-#define tree_create() btree_create()
+#define tree_create(max_entries) btree_create()
 #define tree_lookup(h, hash) ({ int res = btree_find((h), (unsigned char*)&(hash), sizeof(hash), &tmp_entry); res?&tmp_entry:NULL; })
 #define tree_delete(h, hash, old_entry) \
    do { \
@@ -67,6 +67,19 @@ typedef btree_t* hash_t;
    } while(0)
 
 
+#elif PAGECACHE_INDEX == HASHTABLE
+
+#include "indexes/hashtable.h"
+typedef hashtable_t* hash_t;
+#define tree_create(max_entries) hashtable_create(max_entries) // fixed capacity, the other indexes grow
+#define tree_lookup(h, hash) hashtable_lookup((h), (hash))
+#define tree_delete(h, hash, old_entry) hashtable_delete((h), (hash))
+#define tree_insert(h, hash, old_entry, dst, lru_entry) \
+   do { \
+      pagecache_entry_t new_entry = { .page = dst, .lru = lru_entry }; \
+      hashtable_insert((h), (hash), &new_entry); \
+   } while(0)
+
 #endif
 
 
@@ -77,16 +90,50 @@ struct lru {
    void *page;
    int contains_data;
    int dirty;
+   int referenced;                         // CLOCK: the page has been accessed since the last time the hand swept over it
+   int released;                           // shared page cache: the memory of the page has been given back, the entry is in the free list
+   size_t queued_writes, completed_writes; // a write is in flight if they differ
+   uint64_t dirty_since;                   // write-back cache: time (cycles) of the first write that has not been flushed yet, 0 if the page is clean
+};
+
+struct probation_entry {
+   struct lru *lru;
+   uint64_t hash;
 };
 
 struct pagecache {
    char *cached_data;
+   size_t page_size;                   // PAGE_SIZE, or the size of the items for slabs of items bigger than a page
+   size_t max_pages;                   // quota of pages, only modified by the worker that owns the cache
+   size_t target_pages;                // quota set when the page cache is resized or rebalanced (by any thread), adopted by the owner
+   size_t min_pages;                   // the quota never goes below the pages that cannot be evicted (IOs in flight and dirty pages)
+   size_t capacity;                    // pages for which memory is reserved (max_pages <= capacity)
+   size_t nb_pages;                    // pages currently cached
+   struct lru *free_pages;             // released pages, linked by their next field
    hash_t hash_to_page;
+   int replacement;                    // PAGECACHE_LRU or PAGECACHE_CLOCK
+   int admission;                      // PAGECACHE_ADMIT_ALL, PAGECACHE_ADMIT_SCAN_LOW_PRIORITY or PAGECACHE_ADMIT_TINYLFU
+   struct compressedcache *compressed; // second tier of compressed pages evicted from the page cache (COMPRESSED_CACHE), NULL if disabled
+   struct frequency_sketch *sketch;    // TinyLFU: approximate access frequency of pages, NULL with other admission policies
+   struct probation_entry *probation;  // CLOCK: FIFO of low priority pages, evicted first, NULL with LRU
+   size_t probation_size, probation_head, probation_tail;
    struct lru *used_pages, *oldest_page, *newest_page;
    size_t used_page_size;
+   size_t clock_hand;                  // CLOCK: next page to consider for eviction
+   size_t nb_dirty_pages;              // write-back cache: pages that cannot be evicted before being flushed
+   size_t hits, misses;
+   size_t rebalanced_misses;           // shared page cache: misses at the last rebalancing
+   size_t reported_hits, reported_misses;
 };
 
-void page_cache_init(struct pagecache *p);
-int get_page(struct pagecache *p, uint64_t hash, void **page, struct lru **lru);
+void page_cache_init(struct pagecache *p, size_t page_size, size_t cache_size);
+void page_cache_set_policies(struct pagecache *p, int replacement, int admission); // PAGECACHE_REPLACEMENT and PAGECACHE_ADMISSION by default
+void page_cache_init_worker(struct pagecache *p, size_t nb_workers, size_t max_pending_io);
+void page_cache_rebalance(void);
+void page_cache_prefault(void); // Fault the memory of the page caches of the workers in the background
+void page_cache_release_pages(struct pagecache *p);
+void page_cache_resize(size_t cache_size); // Total size of the page caches of the workers, can be called before or after the workers are launched
+size_t page_cache_size(void);
+int get_page(struct pagecache *p, uint64_t hash, int scan, void **page, struct lru **lru);
 
 #endif
@@ -0,0 +1,137 @@
+#include "headers.h"
+
+/*
+ * Per-thread object pools, used on the path of requests (callbacks, items, linked callbacks of the IO engine) instead of malloc.
+ *
+ * Objects are grouped in size classes (powers of 2, from 64B to 128KB) so that all objects are cache-line aligned.
+ * Each thread has a pool per size class. A pool carves objects out of POOL_CHUNK_SIZE chunks that are aligned on their size, so the pool
+ * owning an object is found by rounding the address of the object down to the chunk (chunk->pool).
+ *
+ * Objects are usually freed by another thread than the one that allocated them (items and callbacks are allocated by load injectors and freed by
+ * workers once the request has been processed). These objects are pushed on the remote_free list of the owner pool (lock-free stack), and the owner
+ * takes the whole list when its local free list is empty. Only the owner pops from the stack, and it takes all elements at once, so no ABA problem.
+ *
+ * When a thread exits, its pools are kept in a list of orphan pools that are reused by the next thread that allocates (load injectors are recreated
+ * for every benchmark), so objects freed after the death of their owner are not lost.
+ */
+#define POOL_MIN_SHIFT 6 // 64B
+#define POOL_MAX_SHIFT 17 // 128KB, the biggest items are a bit more than 64KB
+#define NB_POOL_CLASSES (POOL_MAX_SHIFT - POOL_MIN_SHIFT + 1)
+
+struct pool {
+   size_t object_size;
+   void *free;                                      // Local free list, only accessed by the owner
+   void *remote_free __attribute__((aligned(64)));  // Objects freed by other threads
+} __attribute__((aligned(64)));
+
+struct pool_chunk {
+   struct pool *pool;
+} __attribute__((aligned(64)));
+
+struct thread_pools {
+   struct pool pools[NB_POOL_CLASSES];
+   struct thread_pools *next_orphan;
+};
+
+static __thread struct thread_pools *my_pools;
+static struct thread_pools *orphan_pools;
+static pthread_mutex_t orphan_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t pools_key;
+static pthread_once_t pools_key_once = PTHREAD_ONCE_INIT;
+
+static void orphan_thread_pools(void *pools) {
+   struct thread_pools *t = pools;
+   pthread_mutex_lock(&orphan_lock);
+   t->next_orphan = orphan_pools;
+   orphan_pools = t;
+   pthread_mutex_unlock(&orphan_lock);
+}
+
+static void create_pools_key(void) {
+   pthread_key_create(&pools_key, orphan_thread_pools);
+}
+
+static struct thread_pools *get_thread_pools(void) {
+   if(my_pools)
+      return my_pools;
+
+   pthread_once(&pools_key_once, create_pools_key);
+   pthread_mutex_lock(&orphan_lock);
+   my_pools = orphan_pools;
+   if(my_pools)
+      orphan_pools = my_pools->next_orphan;
+   pthread_mutex_unlock(&orphan_lock);
+
+   if(!my_pools) {
+      my_pools = aligned_alloc(64, sizeof(*my_pools));
+      if(!my_pools)
+         die("Cannot allocate object pools\n");
+      memset(my_pools, 0, sizeof(*my_pools));
+      for(size_t i = 0; i < NB_POOL_CLASSES; i++)
+         my_pools->pools[i].object_size = 1LU << (i + POOL_MIN_SHIFT);
+   }
+   pthread_setspecific(pools_key, my_pools);
+   return my_pools;
+}
+
+static size_t size_class(size_t size) {
+   size_t shift = POOL_MIN_SHIFT;
+   while((1LU << shift) < size)
+      shift++;
+   if(shift > POOL_MAX_SHIFT)
+      die("Cannot allocate a %lu bytes object from a pool (max %lu)\n", size, 1LU << POOL_MAX_SHIFT);
+   return shift - POOL_MIN_SHIFT;
+}
+
+static void refill_pool(struct pool *p) {
+   struct pool_chunk *chunk = aligned_alloc(POOL_CHUNK_SIZE, POOL_CHUNK_SIZE);
+   if(!chunk)
+      die("Cannot allocate a chunk for the object pools\n");
+   chunk->pool = p;
+
+   char *first = (char*)chunk + sizeof(*chunk);
+   size_t nb_objects = (POOL_CHUNK_SIZE - sizeof(*chunk)) / p->object_size;
+   for(size_t i = 0; i < nb_objects; i++) {
+      void **object = (void**)(first + i * p->object_size);
+      *object = p->free;
+      p->free = object;
+   }
+}
+
+void *pool_alloc(size_t size) {
+   if(!OBJECT_POOLS)
+      return malloc(size);
+
+   struct pool *p = &get_thread_pools()->pools[size_class(size)];
+   if(!p->free) {
+      p->free = __atomic_exchange_n(&p->remote_free, NULL, __ATOMIC_ACQUIRE);
+      if(!p->free)
+         refill_pool(p);
+   }
+
+   void **object = p->free;
+   p->free = *object;
+   return object;
+}
+
+void pool_free(void *object) {
+   if(!OBJECT_POOLS) {
+      free(object);
+      return;
+   }
+   if(!object)
+      return;
+
+   struct pool_chunk *chunk = (void*)((uint64_t)object & ~(POOL_CHUNK_SIZE - 1));
+   struct pool *p = chunk->pool;
+   void **next = object;
+   if(my_pools && p >= my_pools->pools && p < &my_pools->pools[NB_POOL_CLASSES]) {
+      *next = p->free;
+      p->free = object;
+   } else {
+      void *head = __atomic_load_n(&p->remote_free, __ATOMIC_RELAXED);
+      do {
+         *next = head;
+      } while(!__atomic_compare_exchange_n(&p->remote_free, &head, object, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+   }
+}
@@ -0,0 +1,7 @@
+#ifndef POOL_H
+#define POOL_H 1
+
+void *pool_alloc(size_t size);
+void pool_free(void *object);
+
+#endif
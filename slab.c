@@ -12,6 +12,9 @@
  *
  * Format is [ [size_t rdt1, size_t key_size1, size_t value_size1][key1][value1][maybe some empty space]     [rdt2, key_size2, value_size2][key2]etc. ]
  *
+ * Items bigger than a page span several contiguous pages: the slab is then split in "pages" of slab->page_size bytes (the item size rounded up to PAGE_SIZE)
+ * that contain exactly one item, and that are read and written with one IO.
+ *
  * When an idem is deleted its key_size becomes -1. value_size is then equal to a next free idx in the slab.
  * That way, when we reuse an empty spot, we know where the next one is.
  *
@@ -23,11 +26,11 @@
  * Where is my item in the slab?
  */
 off_t item_page_num(struct slab *s, size_t idx) {
-   size_t items_per_page = PAGE_SIZE/s->item_size;
-   return idx / items_per_page;
+   size_t items_per_page = s->page_size/s->item_size;
+   return idx / items_per_page * (s->page_size / PAGE_SIZE);
 }
 static off_t item_in_page_offset(struct slab *s, size_t idx) {
-   size_t items_per_page = PAGE_SIZE/s->item_size;
+   size_t items_per_page = s->page_size/s->item_size;
    return (idx % items_per_page)*s->item_size;
 }
 
@@ -57,12 +60,12 @@ void add_existing_item(struct slab *s, size_t idx, void *_item, struct slab_call
 
 void process_existing_chunk(int slab_worker_id, struct slab *s, size_t nb_files, size_t file_idx, char *data, size_t start, size_t length, struct slab_callback *callback) {
    static __thread declare_periodic_count;
-   size_t nb_items_per_page = PAGE_SIZE / s->item_size;
-   size_t nb_pages = length / PAGE_SIZE;
+   size_t nb_items_per_page = s->page_size / s->item_size;
+   size_t nb_pages = length / s->page_size;
    for(size_t p = 0; p < nb_pages; p++) {
-      size_t page_num = ((start + p*PAGE_SIZE) / PAGE_SIZE); // Physical page to virtual page
+      size_t page_num = ((start + p*s->page_size) / s->page_size); // Physical page to virtual page
       size_t base_idx = page_num*nb_items_per_page*nb_files + file_idx*nb_items_per_page;
-      size_t current = p*PAGE_SIZE;
+      size_t current = p*s->page_size;
       for(size_t i = 0; i < nb_items_per_page; i++) {
          add_existing_item(s, base_idx, &data[current], callback);
          base_idx++;
@@ -82,10 +85,10 @@ void rebuild_index(int slab_worker_id, struct slab *s, struct slab_callback *cal
       end = start + GRANULARITY_REBUILD;
       if(end > s->size_on_disk)
          end = s->size_on_disk;
-      if( ((end - start) % PAGE_SIZE) != 0)
-         end = end - (end % PAGE_SIZE);
-      if( ((end - start) % PAGE_SIZE) != 0)
-         die("File size is wrong (%%PAGE_SIZE!=0)\n");
+      if( ((end - start) % s->page_size) != 0)
+         end = end - ((end - start) % s->page_size);
+      if( ((end - start) % s->page_size) != 0)
+         die("File size is wrong (%%page_size!=0)\n");
       if(end == start)
          break;
       int r = pread(fd, cached_data, end - start, start);
@@ -103,6 +106,15 @@ void rebuild_index(int slab_worker_id, struct slab *s, struct slab_callback *cal
 
 
 
+static void *slab_extension_thread(void *pdata);
+static void extend_slab_in_background(struct slab *s);
+static pthread_once_t extension_thread_once = PTHREAD_ONCE_INIT;
+static void start_slab_extension_thread(void) {
+   pthread_t t;
+   pthread_create(&t, NULL, slab_extension_thread, NULL);
+   pthread_detach(t);
+}
+
 /*
  * Create a slab: a file that only contains items of a given size.
  * @callback is a callback that will be called on all previously existing items of the slab if it is restored from disk.
@@ -117,16 +129,34 @@ struct slab* create_slab(struct slab_context *ctx, int slab_worker_id, size_t it
    s->fd = open(path,  O_RDWR | O_CREAT | O_DIRECT, 0777);
    if(s->fd == -1)
       perr("Cannot allocate slab %s", path);
+   worker_ioengine_register_file(get_io_context(ctx), s->fd);
+
+   if(item_size <= PAGE_SIZE) {
+      s->page_size = PAGE_SIZE;
+      s->pagecache = get_pagecache(ctx);
+   } else {
+      s->page_size = (item_size + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+      size_t nb_pages = LARGE_ITEMS_CACHE_SIZE / get_nb_workers() / s->page_size;
+      size_t min_pages = 2 * (2 * MAX_NB_PENDING_CALLBACKS_PER_WORKER) + 2; // IO slots of the worker and as many dirty pages, see page_cache_init_worker
+      if(nb_pages < min_pages)
+         nb_pages = min_pages;
+      s->pagecache = calloc(1, sizeof(*s->pagecache));
+      page_cache_init(s->pagecache, s->page_size, nb_pages * s->page_size);
+      s->pagecache->min_pages = min_pages;
+   }
+
+   if(SLAB_BACKGROUND_EXTENSION)
+      pthread_once(&extension_thread_once, start_slab_extension_thread);
 
    fstat(s->fd, &sb);
    s->size_on_disk = sb.st_size;
-   if(s->size_on_disk < 2*PAGE_SIZE) {
-      fallocate(s->fd, 0, 0, 2*PAGE_SIZE);
-      s->size_on_disk = 2*PAGE_SIZE;
+   if(s->size_on_disk < 2*s->page_size) {
+      fallocate(s->fd, 0, 0, 2*s->page_size);
+      s->size_on_disk = 2*s->page_size;
    }
 
-   size_t nb_items_per_page = PAGE_SIZE / item_size;
-   s->nb_max_items = s->size_on_disk / PAGE_SIZE * nb_items_per_page;
+   size_t nb_items_per_page = s->page_size / item_size;
+   s->nb_max_items = s->size_on_disk / s->page_size * nb_items_per_page;
    s->nb_items = 0;
    s->item_size = item_size;
    s->nb_free_items = 0;
@@ -140,28 +170,131 @@ struct slab* create_slab(struct slab_context *ctx, int slab_worker_id, size_t it
       rebuild_index(slab_worker_id, s, callback);
    }
 
+   if(SLAB_BACKGROUND_EXTENSION) // extended while the other slabs are created, before the first inserts
+      extend_slab_in_background(s);
+
    return s;
 }
 
 /*
- * Double the size of a slab on disk
+ * Size of a slab on disk: doubled until 10GB, then 10GB more at a time
+ */
+static size_t next_slab_size(size_t size) {
+   if(size < 10000000000LU)
+      return size * 2;
+   return size + 10000000000LU;
+}
+
+static void set_slab_size(struct slab *s, size_t size) {
+   size_t nb_items_per_page = s->page_size / s->item_size;
+   s->size_on_disk = size;
+   s->nb_max_items = s->size_on_disk / s->page_size * nb_items_per_page;
+}
+
+static __thread uint64_t extension_stall; // cycles spent by the worker in resize_slab
+
+/*
+ * Extend a slab on disk, synchronously. With SLAB_BACKGROUND_EXTENSION this only happens if the background extension is late.
  */
 struct slab* resize_slab(struct slab *s) {
-   if(s->size_on_disk < 10000000000LU) {
-      s->size_on_disk *= 2;
-      if(fallocate(s->fd, 0, 0, s->size_on_disk))
-         perr("Cannot resize slab (item size %lu) new size %lu\n", s->item_size, s->size_on_disk);
-      s->nb_max_items *= 2;
-   } else {
-      size_t nb_items_per_page = PAGE_SIZE / s->item_size;
-      s->size_on_disk += 10000000000LU;
-      if(fallocate(s->fd, 0, 0, s->size_on_disk))
-         perr("Cannot resize slab (item size %lu) new size %lu\n", s->item_size, s->size_on_disk);
-      s->nb_max_items = s->size_on_disk / PAGE_SIZE * nb_items_per_page;
-   }
+   uint64_t start, end;
+   rdtscll(start);
+   size_t size = (s->extension_size > s->size_on_disk)?s->extension_size:next_slab_size(s->size_on_disk); // same size as the background extension, if any
+   if(fallocate(s->fd, 0, 0, size))
+      perr("Cannot resize slab (item size %lu) new size %lu\n", s->item_size, size);
+   set_slab_size(s, size);
+   rdtscll(end);
+   extension_stall += end - start;
    return s;
 }
 
+/* Time spent by the calling worker waiting for slabs to be extended since the last call (displayed in the [WORKER BREAKDOWN] lines) */
+uint64_t slab_extension_stall_us(void) {
+   uint64_t stall = extension_stall;
+   extension_stall = 0;
+   return cycles_to_us(stall);
+}
+
+/*
+ * Background extension of the slabs (SLAB_BACKGROUND_EXTENSION).
+ * fallocate of a big file can take seconds, and all the requests of the worker would wait for it. Instead, when less than
+ * SLAB_EXTENSION_WATERMARK% (or SLAB_EXTENSION_MIN_FREE bytes) of a slab have never been used, the worker asks a background thread to
+ * extend the file and keeps using the current size. The new size is used by the worker once the thread is done (extension_done).
+ */
+struct slab_extension {
+   struct slab *slab;
+   size_t size;
+   struct slab_extension *next;
+};
+
+static pthread_mutex_t extensions_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t extensions_cond = PTHREAD_COND_INITIALIZER;
+static struct slab_extension *extensions;
+
+static void *slab_extension_thread(void *pdata) {
+   while(1) {
+      pthread_mutex_lock(&extensions_lock);
+      while(!extensions)
+         pthread_cond_wait(&extensions_cond, &extensions_lock);
+      struct slab_extension *e = extensions;
+      extensions = e->next;
+      pthread_mutex_unlock(&extensions_lock);
+
+      struct slab *s = e->slab;
+      if(fallocate(s->fd, 0, 0, e->size))
+         perr("Cannot resize slab (item size %lu) new size %lu\n", s->item_size, e->size);
+      __sync_synchronize();
+      s->extension_done = 1;
+      free(e);
+   }
+   return NULL;
+}
+
+static void extend_slab_in_background(struct slab *s) {
+   size_t items_per_page = s->page_size / s->item_size;
+   if(s->extension_size) {
+      if(!s->extension_done)
+         return;
+      __sync_synchronize();
+      if(s->extension_size > s->size_on_disk)
+         set_slab_size(s, s->extension_size);
+      s->extension_size = 0;
+   }
+   size_t used = (s->last_item + items_per_page - 1) / items_per_page * s->page_size;
+   if((s->nb_max_items - s->last_item) * 100 >= s->nb_max_items * SLAB_EXTENSION_WATERMARK && s->size_on_disk - used >= SLAB_EXTENSION_MIN_FREE)
+      return;
+
+   struct slab_extension *e = malloc(sizeof(*e));
+   e->slab = s;
+   e->size = next_slab_size(s->size_on_disk);
+   while(e->size - used < SLAB_EXTENSION_MIN_FREE)
+      e->size = next_slab_size(e->size);
+   s->extension_size = e->size;
+   s->extension_done = 0;
+   pthread_mutex_lock(&extensions_lock);
+   e->next = extensions;
+   extensions = e;
+   pthread_cond_signal(&extensions_cond);
+   pthread_mutex_unlock(&extensions_lock);
+}
+
+/* The file of the slab must not be truncated while it is extended (compaction.c) */
+int slab_is_extending(struct slab *s) {
+   return s->extension_size != 0;
+}
+
+/*
+ * Index of a new item at the end of the slab, the file is extended if needed
+ */
+size_t append_item_idx(struct slab *s) {
+   if(SLAB_BACKGROUND_EXTENSION)
+      extend_slab_in_background(s);
+   if(s->last_item >= s->nb_max_items)
+      resize_slab(s);
+   assert(s->last_item < s->nb_max_items);
+   return s->last_item++;
+}
+
 
 
 
@@ -171,7 +304,7 @@ struct slab* resize_slab(struct slab *s) {
  */
 void *read_item(struct slab *s, size_t idx) {
    size_t page_num = item_page_num(s, idx);
-   char *disk_data = safe_pread(s->fd, page_num*PAGE_SIZE);
+   char *disk_data = safe_pread(s->fd, page_num*PAGE_SIZE, s->page_size);
    return &disk_data[item_in_page_offset(s, idx)];
 }
 
@@ -184,11 +317,21 @@ void *read_item(struct slab *s, size_t idx) {
 void read_item_async_cb(struct slab_callback *callback) {
    char *disk_page = callback->lru_entry->page;
    off_t in_page_offset = item_in_page_offset(callback->slab, callback->slab_idx);
+   if(ITEM_CACHE && !callback->scan)
+      item_cache_admit(get_itemcache(callback->slab->ctx), callback->slab, callback->slab_idx, &disk_page[in_page_offset]);
    if(callback->cb)
       callback->cb(callback, &disk_page[in_page_offset]);
 }
 
 void read_item_async(struct slab_callback *callback) {
+   if(ITEM_CACHE) { // hot small items might be cached without their page
+      char *item = item_cache_get(get_itemcache(callback->slab->ctx), callback->slab, callback->slab_idx);
+      if(item) {
+         if(callback->cb)
+            callback->cb(callback, item);
+         return;
+      }
+   }
    callback->io_cb = read_item_async_cb;
    read_page_async(callback);
 }
@@ -202,8 +345,13 @@ void read_item_async(struct slab_callback *callback) {
 void update_item_async_cb2(struct slab_callback *callback) {
    char *disk_page = callback->lru_entry->page;
    off_t in_page_offset = item_in_page_offset(callback->slab, callback->slab_idx);
+   struct migration *migration = callback->migration;
+   if(migration) // the item has been written in its new slab
+      end_migration(callback);
    if(callback->cb)
       callback->cb(callback, &disk_page[in_page_offset]);
+   if(migration)
+      resume_after_migration(migration);
 }
 
 void update_item_async_cb1(struct slab_callback *callback) {
@@ -236,6 +384,8 @@ void update_item_async_cb1(struct slab_callback *callback) {
       die("Trying to write an item that is too big for its slab\n");
    else
       memcpy(&disk_page[offset_in_page], item, get_item_size(item));
+   if(ITEM_CACHE)
+      item_cache_update(get_itemcache(s->ctx), s, idx, &disk_page[offset_in_page]);
 
    callback->io_cb = update_item_async_cb2;
    write_page_async(callback);
@@ -256,15 +406,16 @@ void add_item_async_cb1(struct slab_callback *callback) {
 
    struct lru *lru_entry = callback->lru_entry;
    if(lru_entry == NULL) { // no free page, append
-      if(s->last_item >= s->nb_max_items)
-         resize_slab(s);
-      callback->slab_idx = s->last_item;
-      assert(s->last_item < s->nb_max_items);
-      s->last_item++;
+      callback->slab_idx = append_item_idx(s);
    } else { // reuse a free spot. Don't forget to add the linked tombstone in the freelist.
       char *disk_page = callback->lru_entry->page;
       off_t in_page_offset = item_in_page_offset(callback->slab, callback->slab_idx);
-      add_son_in_freelist(callback->slab, callback->slab_idx, (void*)(&disk_page[in_page_offset]));
+      struct item_metadata *meta = (void*)(&disk_page[in_page_offset]);
+      if(meta->key_size != -1) { // the spot is used, the freelist has been recovered after a crash during a compaction (compaction.c)
+         add_item_async(callback);
+         return;
+      }
+      add_son_in_freelist(callback->slab, callback->slab_idx, meta);
    }
    s->nb_items++;
 
@@ -277,6 +428,18 @@ void add_item_async(struct slab_callback *callback) {
 }
 
 
+/*
+ * Move an item that grew to the slab of its new size: the item is added in a free spot of the new slab.
+ * The index and the old spot are updated once the item is written (end_migration).
+ */
+void migrate_item_async(struct slab_callback *callback, struct slab *new_slab) {
+   callback->action = ADD; // the new spot doesn't contain the item yet
+   callback->slab = new_slab;
+   callback->slab_idx = -1;
+   add_item_async(callback);
+}
+
+
 /*
  * Remove an item
  */
@@ -297,6 +460,8 @@ void remove_item_by_idx_async_cb1(struct slab_callback *callback) {
 
    meta->rdt = get_rdt(s->ctx);
    meta->key_size = -1;
+   if(ITEM_CACHE)
+      item_cache_remove(get_itemcache(s->ctx), s, idx);
 
    s->nb_items--;
    add_item_in_free_list(s, idx, meta);
@@ -18,10 +18,15 @@ struct slab {
 
    int fd;
    size_t size_on_disk;
+   size_t page_size;            // Size of the IOs done on the slab: PAGE_SIZE, or the item size rounded up to PAGE_SIZE if items are bigger than a page
+   struct pagecache *pagecache; // Items bigger than a page have their own page cache (with pages of page_size bytes)
 
    size_t nb_free_items, nb_free_items_in_memory;
    struct freelist_entry *freed_items, *freed_items_tail;
    btree_t *freed_items_recovery, *freed_items_pointed_to;
+   struct compaction *compaction; // NULL unless the slab is being compacted (compaction.c)
+   size_t extension_size;         // Size of the file once it has been extended in the background, 0 if no extension is in progress
+   volatile int extension_done;
 };
 
 /* This is the callback enqueued in the engine.
@@ -30,10 +35,13 @@ struct slab {
  */
 typedef void (slab_cb_t)(struct slab_callback *, void *item);
 enum slab_action { ADD, UPDATE, DELETE, READ, READ_NO_LOOKUP, ADD_OR_UPDATE };
+enum slab_ack { ACK_ON_DISK, ACK_ON_CACHE };
 struct slab_callback {
    slab_cb_t *cb;
    void *payload;
    void *item;
+   enum slab_ack ack; // With WRITE_BACK_CACHE, writes call cb once the page cache is modified (ACK_ON_CACHE) or once the page is flushed (ACK_ON_DISK)
+   int scan; // The item is read by a scan (READ_NO_LOOKUP), if its page is not cached it is cached with a low priority (PAGECACHE_ADMISSION)
 
    // Private
    enum slab_action action;
@@ -44,15 +52,20 @@ struct slab_callback {
    };
    struct lru *lru_entry;
    io_cb_t *io_cb;
+   struct migration *migration; // UPDATE of an item that grew and is moved to another slab, see slabworker.c
 };
 
 struct slab* create_slab(struct slab_context *ctx, int worker_id, size_t item_size, struct slab_callback *callback);
 struct slab* resize_slab(struct slab *s);
+size_t append_item_idx(struct slab *s);
+int slab_is_extending(struct slab *s);
+uint64_t slab_extension_stall_us(void);
 
 void *read_item(struct slab *s, size_t idx);
 void read_item_async(struct slab_callback *callback);
 void add_item_async(struct slab_callback *callback);
 void update_item_async(struct slab_callback *callback);
+void migrate_item_async(struct slab_callback *callback, struct slab *new_slab);
 void remove_item_async(struct slab_callback *callback);
 
 off_t item_page_num(struct slab *s, size_t idx);
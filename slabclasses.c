@@ -0,0 +1,268 @@
+#include "headers.h"
+
+/*
+ * Slab classes: items are stored in the slab of the smallest class that is at least as big as the item, so an item of 520B wastes the
+ * end of a 1024B slot. The best classes depend on the sizes of the items of the workload.
+ *
+ * The classes are chosen when the database is created (-s option of main, DEFAULT_SLAB_CLASSES otherwise) and persisted in
+ * SLAB_CLASSES_PATH on every disk, so that recovery (create_slab) opens the slabs of the right classes. Databases created before the
+ * classes were persisted use the default classes.
+ *
+ * With SLAB_CLASSES_SAMPLING, workers record the histogram of the sizes of 1 in SLAB_CLASSES_SAMPLING items that are added or updated (each
+ * sample is counted SLAB_CLASSES_SAMPLING times, so that the cost of a class stays comparable to the space of the items), and print_slab_classes_stats
+ * prints the space wasted by the current classes and recommends the classes that waste the least space for the recorded histogram:
+ *  - An item of a class smaller than a page uses PAGE_SIZE / (PAGE_SIZE / class) bytes (items don't span pages), so for a given number of
+ *    items per page the best class is the biggest one, PAGE_SIZE / k. Classes bigger than a page use a multiple of PAGE_SIZE bytes.
+ *  - A dynamic program then chooses the best get_nb_slab_classes() classes amongst these candidates (the biggest class is always kept so that
+ *    items bigger than the ones that have been sampled still fit). Each class also costs the half empty last page of its slab in every
+ *    worker, so that a few odd sized items don't get a class of their own.
+ */
+
+#define DEFAULT_SLAB_CLASSES "100,128,256,400,512,1024,1365,2048,4096,8192,16384,32768,65536,69632"
+
+static size_t slab_classes[MAX_SLAB_CLASSES];
+static size_t nb_slab_classes;
+static int classes_from_command_line;
+
+/*
+ * Histogram of item sizes: sizes up to PAGE_SIZE are counted exactly, bigger sizes by number of pages.
+ * The number of bytes of the items of each bucket is also recorded to compute the wasted space exactly.
+ */
+#define HISTOGRAM_BUCKETS (PAGE_SIZE + MAX_SLAB_ITEM_SIZE / PAGE_SIZE + 1)
+struct size_histogram {
+   size_t count[HISTOGRAM_BUCKETS];
+   size_t bytes[HISTOGRAM_BUCKETS];
+};
+static struct size_histogram *histograms; // one per worker
+
+static size_t parse_classes(const char *list, size_t *classes) {
+   size_t nb = 0;
+   const char *c = list;
+   while(*c && *c != '\n') {
+      char *end;
+      size_t size = strtoul(c, &end, 10);
+      if(end == c)
+         die("Invalid slab classes %s\n", list);
+      if(nb == MAX_SLAB_CLASSES)
+         die("Too many slab classes (max %d)\n", MAX_SLAB_CLASSES);
+      if(size <= sizeof(struct item_metadata) || size > MAX_SLAB_ITEM_SIZE || (nb && size <= classes[nb - 1]))
+         die("Invalid slab classes %s: sizes must be increasing and at most %lu bytes\n", list, MAX_SLAB_ITEM_SIZE);
+      classes[nb++] = size;
+      while(*end == ',' || *end == '\n' || *end == ' ')
+         end++;
+      c = end;
+   }
+   if(!nb)
+      die("No slab class in %s\n", list);
+   return nb;
+}
+
+static void classes_to_string(size_t *classes, size_t nb, char *str) {
+   str[0] = '\0';
+   for(size_t i = 0; i < nb; i++)
+      sprintf(str + strlen(str), "%s%lu", i?",":"", classes[i]);
+}
+
+void slab_classes_set(const char *sizes) {
+   nb_slab_classes = parse_classes(sizes, slab_classes);
+   classes_from_command_line = 1;
+}
+
+void slab_classes_init(int nb_disks) {
+   char path[512], str[4096];
+   const char *source = "command line";
+   if(!nb_slab_classes)
+      nb_slab_classes = parse_classes(DEFAULT_SLAB_CLASSES, slab_classes);
+
+   sprintf(path, SLAB_CLASSES_PATH, 0LU);
+   FILE *f = fopen(path, "r");
+   if(f) {
+      size_t persisted[MAX_SLAB_CLASSES];
+      if(!fgets(str, sizeof(str), f))
+         str[0] = '\0';
+      fclose(f);
+      str[strcspn(str, "\n")] = '\0';
+      size_t nb_persisted = parse_classes(str, persisted);
+      if(classes_from_command_line && (nb_persisted != nb_slab_classes || memcmp(persisted, slab_classes, nb_persisted * sizeof(*persisted))))
+         die("The database has been created with other slab classes (%s), delete it to change the classes\n", str);
+      memcpy(slab_classes, persisted, nb_persisted * sizeof(*persisted));
+      nb_slab_classes = nb_persisted;
+      source = path;
+   } else {
+      sprintf(path, PATH, 0LU, 0, 0LU, 100LU);
+      if(!access(path, F_OK)) { // database created before classes were persisted, it uses the default classes
+         if(classes_from_command_line)
+            die("The database has been created with the default slab classes, delete it to change the classes\n");
+         source = "existing database";
+      } else if(!classes_from_command_line) {
+         source = "default";
+      }
+      classes_to_string(slab_classes, nb_slab_classes, str);
+      for(size_t d = 0; d < nb_disks; d++) {
+         sprintf(path, SLAB_CLASSES_PATH, d);
+         f = fopen(path, "w");
+         if(!f)
+            perr("Cannot persist the slab classes in %s", path);
+         fprintf(f, "%s\n", str);
+         fclose(f);
+      }
+   }
+
+   classes_to_string(slab_classes, nb_slab_classes, str);
+   printf("#Slab classes (%s): %s\n", source, str);
+
+   if(SLAB_CLASSES_SAMPLING)
+      histograms = calloc(get_nb_workers(), sizeof(*histograms));
+}
+
+size_t get_nb_slab_classes(void) {
+   return nb_slab_classes;
+}
+
+size_t get_slab_class_size(size_t class) {
+   return slab_classes[class];
+}
+
+/* Called by the worker that owns the item */
+void slab_classes_sample(int worker_id, size_t item_size) {
+   struct size_histogram *h = &histograms[worker_id];
+   size_t bucket = (item_size <= PAGE_SIZE)?item_size:(PAGE_SIZE + (item_size - 1) / PAGE_SIZE);
+   h->count[bucket] += SLAB_CLASSES_SAMPLING;
+   h->bytes[bucket] += item_size * SLAB_CLASSES_SAMPLING;
+}
+
+/* Biggest item size of a bucket */
+static size_t bucket_size(size_t bucket) {
+   return (bucket <= PAGE_SIZE)?bucket:((bucket - PAGE_SIZE + 1) * PAGE_SIZE);
+}
+
+/* Space used by an item of a class, including the end of the page that cannot be used */
+static double bytes_per_item(size_t class) {
+   if(class <= PAGE_SIZE)
+      return (double)PAGE_SIZE / (PAGE_SIZE / class);
+   return (class + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+}
+
+/* Smallest class that has the same number of items per page (or pages per item) as an item of this size */
+static size_t best_class(size_t size) {
+   if(size <= PAGE_SIZE)
+      return PAGE_SIZE / (PAGE_SIZE / size);
+   return (size + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+}
+
+/* Choose at most nb_classes classes that minimize the space used by the items of the histogram, returns the number of classes */
+static size_t recommend_classes(struct size_histogram *h, size_t nb_classes, size_t *classes) {
+   size_t candidates[HISTOGRAM_BUCKETS], nb_candidates = 0;
+   double count[HISTOGRAM_BUCKETS + 1], bytes[HISTOGRAM_BUCKETS + 1]; // prefix sums, per candidate
+   count[0] = bytes[0] = 0;
+   for(size_t b = 0; b < HISTOGRAM_BUCKETS; b++) {
+      if(!h->count[b])
+         continue;
+      size_t c = best_class(bucket_size(b)); // buckets are sorted by size, so are their classes
+      if(!nb_candidates || candidates[nb_candidates - 1] != c) {
+         candidates[nb_candidates++] = c;
+         count[nb_candidates] = count[nb_candidates - 1];
+         bytes[nb_candidates] = bytes[nb_candidates - 1];
+      }
+      count[nb_candidates] += h->count[b];
+      bytes[nb_candidates] += h->bytes[b];
+   }
+   if(!nb_candidates)
+      return 0;
+
+   int keep_biggest = (candidates[nb_candidates - 1] < slab_classes[nb_slab_classes - 1]);
+   size_t k_max = nb_classes - keep_biggest;
+   if(k_max > nb_candidates)
+      k_max = nb_candidates;
+   if(k_max == 0) { // only one class, it must hold the biggest items
+      classes[0] = slab_classes[nb_slab_classes - 1];
+      return 1;
+   }
+
+   // wasted[k][j] = space wasted by the items up to candidate j with k classes, the biggest being candidate j
+   double *wasted = malloc((k_max + 1) * nb_candidates * sizeof(*wasted));
+   size_t *prev = malloc((k_max + 1) * nb_candidates * sizeof(*prev));
+   #define W(k, j) wasted[(k) * nb_candidates + (j)]
+   #define P(k, j) prev[(k) * nb_candidates + (j)]
+   double class_cost = PAGE_SIZE / 2 * get_nb_workers();
+   for(size_t j = 0; j < nb_candidates; j++)
+      W(1, j) = class_cost + count[j + 1] * bytes_per_item(candidates[j]) - bytes[j + 1];
+   for(size_t k = 2; k <= k_max; k++) {
+      for(size_t j = 0; j < nb_candidates; j++) {
+         W(k, j) = W(k - 1, j);
+         P(k, j) = -1;
+         for(size_t i = 0; i < j; i++) {
+            double w = W(k - 1, i) + class_cost + (count[j + 1] - count[i + 1]) * bytes_per_item(candidates[j]) - (bytes[j + 1] - bytes[i + 1]);
+            if(w < W(k, j)) {
+               W(k, j) = w;
+               P(k, j) = i;
+            }
+         }
+      }
+   }
+
+   size_t nb = 0;
+   size_t j = nb_candidates - 1;
+   for(size_t k = k_max; k >= 1; k--) { // backtrack from the biggest class
+      while(k > 1 && P(k, j) == (size_t)-1)
+         k--;
+      classes[nb++] = candidates[j];
+      if(k == 1)
+         break;
+      j = P(k, j);
+   }
+   #undef W
+   #undef P
+   free(wasted);
+   free(prev);
+   for(size_t i = 0; i < nb / 2; i++) {
+      size_t tmp = classes[i];
+      classes[i] = classes[nb - 1 - i];
+      classes[nb - 1 - i] = tmp;
+   }
+   if(keep_biggest)
+      classes[nb++] = slab_classes[nb_slab_classes - 1];
+   return nb;
+}
+
+/* Percentage of the space used by the items of the histogram that is wasted by the classes */
+static double wasted_space(struct size_histogram *h, size_t *classes, size_t nb_classes) {
+   double used = 0, data = 0;
+   for(size_t b = 0; b < HISTOGRAM_BUCKETS; b++) {
+      if(!h->count[b])
+         continue;
+      size_t c = 0;
+      while(c < nb_classes - 1 && classes[c] < bucket_size(b))
+         c++;
+      used += h->count[b] * bytes_per_item(classes[c]);
+      data += h->bytes[b];
+   }
+   return used?(used - data) * 100. / used:0;
+}
+
+void print_slab_classes_stats(void) {
+   if(!SLAB_CLASSES_SAMPLING)
+      return;
+
+   struct size_histogram *h = calloc(1, sizeof(*h));
+   size_t nb_items = 0;
+   for(size_t w = 0; w < get_nb_workers(); w++) {
+      for(size_t b = 0; b < HISTOGRAM_BUCKETS; b++) {
+         h->count[b] += histograms[w].count[b];
+         h->bytes[b] += histograms[w].bytes[b];
+         nb_items += histograms[w].count[b];
+      }
+   }
+   if(!nb_items) {
+      free(h);
+      return;
+   }
+
+   char str[4096];
+   size_t recommended[MAX_SLAB_CLASSES];
+   size_t nb_recommended = recommend_classes(h, nb_slab_classes, recommended);
+   printf("#Slab classes: %.1f%% of the space used by the %lu written items is wasted (sampled 1 in %d)\n", wasted_space(h, slab_classes, nb_slab_classes), nb_items, SLAB_CLASSES_SAMPLING);
+   classes_to_string(recommended, nb_recommended, str);
+   printf("#\tRecommended classes for a new database: -s %s (%.1f%% wasted)\n", str, wasted_space(h, recommended, nb_recommended));
+   free(h);
+}
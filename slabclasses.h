@@ -0,0 +1,12 @@
+#ifndef SLAB_CLASSES_H
+#define SLAB_CLASSES_H 1
+
+void slab_classes_set(const char *sizes); // -s option of main, classes of a new database
+void slab_classes_init(int nb_disks);
+size_t get_nb_slab_classes(void);
+size_t get_slab_class_size(size_t class);
+
+void slab_classes_sample(int worker_id, size_t item_size);
+void print_slab_classes_stats(void);
+
+#endif
@@ -43,7 +43,6 @@ int get_nb_disks(void) {
 /*
  * Worker context - Each worker thread in KVell has one of these structure
  */
-size_t slab_sizes[] = { 100, 128, 256, 400, 512, 1024, 1365, 2048, 4096 };
 struct slab_context {
    size_t worker_id __attribute__((aligned(64)));        // ID
    struct slab **slabs;                                  // Files managed by this worker
@@ -53,8 +52,12 @@ struct slab_context {
    volatile size_t processed_callbacks;                  // Number of requests fully submitted and processed on disk
    size_t max_pending_callbacks;                         // Maximum number of enqueued requests
    struct pagecache *pagecache __attribute__((aligned(64)));
+   struct itemcache *itemcache;                          // NULL if !ITEM_CACHE
    struct io_context *io_ctx;
    uint64_t rdt;                                         // Latest timestamp
+   struct migration *migrations;                         // Items that are being moved to the slab of their new size
+   struct compaction *compaction;                        // NULL if !SLAB_COMPACTION && !SLAB_CLUSTERING
+   size_t nb_unsampled_items;                            // Items added or updated since the last one sampled (SLAB_CLASSES_SAMPLING)
 } *slab_contexts;
 
 /* A file is only managed by 1 worker. File => worker function. */
@@ -66,6 +69,10 @@ struct pagecache *get_pagecache(struct slab_context *ctx) {
    return ctx->pagecache;
 }
 
+struct itemcache *get_itemcache(struct slab_context *ctx) {
+   return ctx->itemcache;
+}
+
 struct io_context *get_io_context(struct slab_context *ctx) {
    return ctx->io_ctx;
 }
@@ -129,8 +136,8 @@ size_t get_item_size(char *item) {
 
 static struct slab *get_slab(struct slab_context *ctx, void *item) {
    size_t item_size = get_item_size(item);
-   for(size_t i = 0; i < sizeof(slab_sizes)/sizeof(*slab_sizes); i++) {
-      if(item_size <= slab_sizes[i])
+   for(size_t i = 0; i < get_nb_slab_classes(); i++) {
+      if(item_size <= get_slab_class_size(i))
          return ctx->slabs[i];
    }
    die("Item is too big\n");
@@ -144,6 +151,7 @@ struct slab *get_item_slab(int worker_id, void *item) {
 static void enqueue_slab_callback(struct slab_context *ctx, enum slab_action action, struct slab_callback *callback) {
    size_t buffer_idx = get_slab_buffer(ctx);
    callback->action = action;
+   callback->migration = NULL;
    ctx->callbacks[buffer_idx] = callback;
    add_time_in_payload(callback, 0);
    submit_slab_buffer(ctx, buffer_idx);
@@ -155,11 +163,10 @@ static void enqueue_slab_callback(struct slab_context *ctx, enum slab_action act
  */
 void *kv_read_sync(void *item) {
    struct slab_context *ctx = get_slab_context(item);
-   struct slab *s = get_slab(ctx, item);
    // Warning, this is very unsafe, the lookup might not be performed in the worker context => race! We only use that during init.
    index_entry_t *e = memory_index_lookup(ctx->worker_id, item);
    if(e)
-      return read_item(s, e->slab_idx);
+      return read_item(e->slab, e->slab_idx); // not always the slab of the size of the item, items that shrunk stay in their slab
    else
       return NULL;
 }
@@ -196,14 +203,271 @@ void kv_remove_async(struct slab_callback *callback) {
    return enqueue_slab_callback(ctx, DELETE, callback);
 }
 
+/*
+ * Number of different pages that contain the items of the scans (print_scan_stats), i.e., how well the slabs are clustered (compaction.c)
+ */
+static volatile size_t nb_scans, scanned_items, scanned_pages;
+
+struct scanned_page {
+   struct slab *slab;
+   size_t page;
+};
+
+static int scanned_page_cmp(const void *a, const void *b) {
+   const struct scanned_page *p1 = a, *p2 = b;
+   if(p1->slab != p2->slab)
+      return (p1->slab < p2->slab)?-1:1;
+   return (p1->page > p2->page) - (p1->page < p2->page);
+}
+
+static void count_scanned_pages(tree_scan_res_t *res) {
+   if(!res->nb_entries)
+      return;
+   struct scanned_page *pages = malloc(res->nb_entries * sizeof(*pages));
+   for(size_t i = 0; i < res->nb_entries; i++) {
+      struct slab *s = res->entries[i].slab;
+      pages[i].slab = s;
+      pages[i].page = res->entries[i].slab_idx / (s->page_size / s->item_size);
+   }
+   qsort(pages, res->nb_entries, sizeof(*pages), scanned_page_cmp);
+   size_t nb_pages = 1;
+   for(size_t i = 1; i < res->nb_entries; i++)
+      nb_pages += scanned_page_cmp(&pages[i - 1], &pages[i]) != 0;
+   free(pages);
+
+   __sync_fetch_and_add(&nb_scans, 1);
+   __sync_fetch_and_add(&scanned_items, res->nb_entries);
+   __sync_fetch_and_add(&scanned_pages, nb_pages);
+}
+
 tree_scan_res_t kv_init_scan(void *item, size_t scan_size) {
-   return memory_index_scan(item, scan_size);
+   tree_scan_res_t res = memory_index_scan(item, scan_size);
+   count_scanned_pages(&res);
+   return res;
+}
+
+void print_scan_stats(void) {
+   size_t scans = __sync_lock_test_and_set(&nb_scans, 0);
+   size_t items = __sync_lock_test_and_set(&scanned_items, 0);
+   size_t pages = __sync_lock_test_and_set(&scanned_pages, 0);
+   if(!scans)
+      return;
+   printf("#Scans: %lu scans, %.1f items per scan in %.1f pages per scan\n", scans, (double)items / scans, (double)pages / scans);
 }
 
 /*
  * Worker context
  */
 
+/*
+ * Items that grew don't fit in their spot anymore: an UPDATE then moves the item to the slab of its new size (migrate_item_async).
+ * Once the item is written in its new spot, the index points to it and the old spot is freed, its tombstone is written by an internal
+ * DELETE request (end_migration). Until then the index points to the old spot, so the following requests on the item wait for the
+ * migration and are processed in order once it is done (resume_after_migration).
+ * Every move increases the timestamp of the worker (begin_item_move), so the copy in the new spot is written with a timestamp strictly greater
+ * than the one of any copy written before. The worker loop alone is not enough: an in-place UPDATE and a growing UPDATE processed in the same
+ * pass would get the same timestamp, and on a tie recovery keeps the copy it scans first, i.e., the old one in the smaller slab. With the
+ * bump, if the process stops before the tombstone is written, recovery keeps the new copy (worker_slab_init_cb).
+ */
+struct waiting_callback {
+   struct slab_callback *callback;
+   struct waiting_callback *next;
+};
+
+struct migration {
+   struct slab_context *ctx;
+   struct slab_callback *callback;                       // UPDATE that moves the item
+   struct slab *old_slab;
+   size_t old_slab_idx;
+   struct waiting_callback *waiting, *last_waiting;      // Requests on the same item, in order
+   struct migration *prev, *next;
+};
+
+static int same_key(char *item1, char *item2) {
+   struct item_metadata *meta1 = (void*)item1, *meta2 = (void*)item2;
+   return meta1->key_size == meta2->key_size && !memcmp(&item1[sizeof(*meta1)], &item2[sizeof(*meta2)], meta1->key_size);
+}
+
+static struct migration *find_migration(struct slab_context *ctx, void *item) {
+   for(struct migration *m = ctx->migrations; m; m = m->next)
+      if(same_key(m->callback->item, item))
+         return m;
+   return NULL;
+}
+
+static int wait_for_migration(struct slab_context *ctx, struct slab_callback *callback) {
+   struct migration *m = find_migration(ctx, callback->item);
+   if(!m)
+      return 0;
+   struct waiting_callback *w = pool_alloc(sizeof(*w));
+   w->callback = callback;
+   w->next = NULL;
+   if(m->last_waiting)
+      m->last_waiting->next = w;
+   else
+      m->waiting = w;
+   m->last_waiting = w;
+   return 1;
+}
+
+/* The item of callback is moved from old_slab[old_slab_idx], requests on the item wait until end_item_move. Also used by compaction.c. */
+struct migration *begin_item_move(struct slab_context *ctx, struct slab_callback *callback, struct slab *old_slab, size_t old_slab_idx) {
+   struct migration *m = pool_alloc(sizeof(*m));
+   memset(m, 0, sizeof(*m));
+   m->ctx = ctx;
+   m->callback = callback;
+   m->old_slab = old_slab;
+   m->old_slab_idx = old_slab_idx;
+   m->next = ctx->migrations;
+   if(m->next)
+      m->next->prev = m;
+   ctx->migrations = m;
+   ctx->rdt++;
+   return m;
+}
+
+int item_is_moving(struct slab_context *ctx, void *item) {
+   return find_migration(ctx, item) != NULL;
+}
+
+static void unlink_migration(struct migration *m) {
+   struct slab_context *ctx = m->ctx;
+   if(m->prev)
+      m->prev->next = m->next;
+   else
+      ctx->migrations = m->next;
+   if(m->next)
+      m->next->prev = m->prev;
+}
+
+static void start_migration(struct slab_context *ctx, struct slab_callback *callback, index_entry_t *e) {
+   callback->migration = begin_item_move(ctx, callback, e->slab, e->slab_idx);
+   migrate_item_async(callback, get_slab(ctx, callback->item));
+}
+
+static void free_tombstone_callback(struct slab_callback *callback, void *item) {
+   pool_free(callback);
+}
+
+/* Called by update_item_async_cb2 before the callback of the UPDATE */
+void end_migration(struct slab_callback *callback) {
+   struct migration *m = callback->migration;
+   struct slab_context *ctx = m->ctx;
+   memory_index_delete(ctx->worker_id, callback->item);
+   memory_index_add(callback, callback->item);
+
+   struct slab_callback *tombstone = pool_alloc(sizeof(*tombstone));
+   memset(tombstone, 0, sizeof(*tombstone));
+   tombstone->cb = free_tombstone_callback;
+   tombstone->action = DELETE;
+   tombstone->slab = m->old_slab;
+   tombstone->slab_idx = m->old_slab_idx;
+   remove_item_async(tombstone);
+
+   unlink_migration(m);
+   callback->migration = NULL;
+}
+
+static void process_request(struct slab_context *ctx, struct slab_callback *callback);
+
+/* Called by update_item_async_cb2 after the callback of the UPDATE (which may have freed it) */
+void resume_after_migration(struct migration *m) {
+   struct waiting_callback *w = m->waiting;
+   struct slab_context *ctx = m->ctx;
+   pool_free(m);
+   while(w) {
+      struct waiting_callback *next = w->next;
+      process_request(ctx, w->callback); // may wait again if it starts a new migration of the item
+      pool_free(w);
+      w = next;
+   }
+}
+
+/* The index points to the new spot of the item */
+void end_item_move(struct migration *m) {
+   unlink_migration(m);
+   resume_after_migration(m);
+}
+
+/* Lookup the item in the index and send the request to its slab */
+static void process_request(struct slab_context *ctx, struct slab_callback *callback) {
+   enum slab_action action = callback->action;
+   if(ctx->migrations && action != READ_NO_LOOKUP && wait_for_migration(ctx, callback))
+      return;
+
+   index_entry_t *e = NULL;
+   if(action != READ_NO_LOOKUP)
+      e = memory_index_lookup(ctx->worker_id, callback->item);
+
+   switch(action) {
+      case READ_NO_LOOKUP:
+         read_item_async(callback);
+         break;
+      case READ:
+         if(!e) { // Item is not in DB
+            callback->slab = NULL;
+            callback->slab_idx = -1;
+            callback->cb(callback, NULL);
+         } else {
+            callback->slab = e->slab;
+            callback->slab_idx = e->slab_idx;
+            read_item_async(callback);
+         }
+         break;
+      case ADD:
+         if(e) {
+            die("Adding item that is already in the database! Use update instead! (This error might also appear if 2 keys have the same prefix, TODO: make index more robust to that.)\n");
+         } else {
+            callback->slab = get_slab(ctx, callback->item);
+            callback->slab_idx = -1;
+            add_item_async(callback);
+         }
+         break;
+      case UPDATE:
+         if(!e) {
+            callback->slab = NULL;
+            callback->slab_idx = -1;
+            callback->cb(callback, NULL);
+         } else if(get_item_size(callback->item) > e->slab->item_size) { // Item grew, move it to the slab of its new size
+            start_migration(ctx, callback, e);
+         } else {
+            callback->slab = e->slab;
+            callback->slab_idx = e->slab_idx;
+            update_item_async(callback);
+         }
+         break;
+      case ADD_OR_UPDATE:
+         if(!e) {
+            callback->action = ADD;
+            callback->slab = get_slab(ctx, callback->item);
+            callback->slab_idx = -1;
+            add_item_async(callback);
+         } else if(get_item_size(callback->item) > e->slab->item_size) {
+            start_migration(ctx, callback, e);
+         } else {
+            callback->action = UPDATE;
+            callback->slab = e->slab;
+            callback->slab_idx = e->slab_idx;
+            update_item_async(callback);
+         }
+         break;
+      case DELETE:
+         if(!e) {
+            callback->slab = NULL;
+            callback->slab_idx = -1;
+            callback->cb(callback, NULL);
+         } else {
+            callback->slab = e->slab;
+            callback->slab_idx = e->slab_idx;
+            memory_index_delete(ctx->worker_id, callback->item);
+            remove_item_async(callback);
+         }
+         break;
+      default:
+         die("Unknown action\n");
+   }
+}
+
 /* Dequeue enqueued callbacks */
 static void worker_dequeue_requests(struct slab_context *ctx) {
    size_t retries =  0;
@@ -211,87 +475,27 @@ static void worker_dequeue_requests(struct slab_context *ctx) {
    size_t pending = sent_callbacks - ctx->processed_callbacks;
    if(pending == 0)
       return;
+   if(PARTIAL_IO_COMPLETIONS && io_pending(ctx->io_ctx) >= (NEVER_EXCEED_QUEUE_DEPTH?io_queue_depth(ctx->io_ctx):ctx->max_pending_callbacks))
+      return; // IOs of the previous requests are still in flight, don't accumulate more
 again:
    for(size_t i = 0; i < pending; i++) {
       struct slab_callback *callback = ctx->callbacks[ctx->processed_callbacks%ctx->max_pending_callbacks];
       enum slab_action action = callback->action;
       add_time_in_payload(callback, 2);
 
-      index_entry_t *e = NULL;
-      if(action != READ_NO_LOOKUP)
-         e = memory_index_lookup(ctx->worker_id, callback->item);
-
-      switch(action) {
-         case READ_NO_LOOKUP:
-            read_item_async(callback);
-            break;
-         case READ:
-            if(!e) { // Item is not in DB
-               callback->slab = NULL;
-               callback->slab_idx = -1;
-               callback->cb(callback, NULL);
-            } else {
-               callback->slab = e->slab;
-               callback->slab_idx = e->slab_idx;
-               read_item_async(callback);
-            }
-            break;
-         case ADD:
-            if(e) {
-               die("Adding item that is already in the database! Use update instead! (This error might also appear if 2 keys have the same prefix, TODO: make index more robust to that.)\n");
-            } else {
-               callback->slab = get_slab(ctx, callback->item);
-               callback->slab_idx = -1;
-               add_item_async(callback);
-            }
-            break;
-         case UPDATE:
-            if(!e) {
-               callback->slab = NULL;
-               callback->slab_idx = -1;
-               callback->cb(callback, NULL);
-            } else {
-               callback->slab = e->slab;
-               callback->slab_idx = e->slab_idx;
-               assert(get_item_size(callback->item) <= e->slab->item_size); // Item grew, this is not supported currently!
-               update_item_async(callback);
-            }
-            break;
-         case ADD_OR_UPDATE:
-            if(!e) {
-               callback->action = ADD;
-               callback->slab = get_slab(ctx, callback->item);
-               callback->slab_idx = -1;
-               add_item_async(callback);
-            } else {
-               callback->action = UPDATE;
-               callback->slab = e->slab;
-               callback->slab_idx = e->slab_idx;
-               assert(get_item_size(callback->item) <= e->slab->item_size); // Item grew, this is not supported currently!
-               update_item_async(callback);
-            }
-         case DELETE:
-            if(!e) {
-               callback->slab = NULL;
-               callback->slab_idx = -1;
-               callback->cb(callback, NULL);
-            } else {
-               callback->slab = e->slab;
-               callback->slab_idx = e->slab_idx;
-               memory_index_delete(ctx->worker_id, callback->item);
-               remove_item_async(callback);
-            }
-            break;
-         default:
-            die("Unknown action\n");
+      if(SLAB_CLASSES_SAMPLING && (action == ADD || action == UPDATE || action == ADD_OR_UPDATE) && ++ctx->nb_unsampled_items >= SLAB_CLASSES_SAMPLING) {
+         ctx->nb_unsampled_items = 0;
+         slab_classes_sample(ctx->worker_id, get_item_size(callback->item));
       }
+
+      process_request(ctx, callback);
       ctx->processed_callbacks++;
-      if(NEVER_EXCEED_QUEUE_DEPTH && io_pending(ctx->io_ctx) >= QUEUE_DEPTH)
+      if(NEVER_EXCEED_QUEUE_DEPTH && io_pending(ctx->io_ctx) >= io_queue_depth(ctx->io_ctx))
          break;
    }
 
    if(WAIT_A_BIT_FOR_MORE_IOS) {
-      while(retries < 5 && io_pending(ctx->io_ctx) < QUEUE_DEPTH) {
+      while(retries < 5 && io_pending(ctx->io_ctx) < io_queue_depth(ctx->io_ctx)) {
          retries++;
          pending = ctx->sent_callbacks - ctx->processed_callbacks;
          if(pending == 0) {
@@ -329,24 +533,36 @@ static void *worker_slab_init(void *pdata) {
 
    pid_t x = syscall(__NR_gettid);
    printf("[SLAB WORKER %lu] tid %d\n", ctx->worker_id, x);
-   pin_me_on(ctx->worker_id);
+   if(NUMA_PLACEMENT) {
+      numa_place_worker(ctx->worker_id);
+      // The ring is filled by the load injectors, touch it now so that it is allocated on the node of the worker
+      ctx->callbacks = calloc(ctx->max_pending_callbacks, sizeof(*ctx->callbacks));
+      memset(ctx->callbacks, 0, ctx->max_pending_callbacks * sizeof(*ctx->callbacks));
+   } else {
+      pin_me_on(ctx->worker_id);
+      ctx->callbacks = calloc(ctx->max_pending_callbacks, sizeof(*ctx->callbacks));
+   }
 
    /* Create the pagecache for the worker */
    ctx->pagecache = calloc(1, sizeof(*ctx->pagecache));
-   page_cache_init(ctx->pagecache);
+   page_cache_init_worker(ctx->pagecache, get_nb_workers(), 2 * ctx->max_pending_callbacks); // IO slots of the worker, see worker_ioengine_init
+   if(ITEM_CACHE)
+      ctx->itemcache = item_cache_init(ITEM_CACHE_SIZE/get_nb_workers());
 
    /* Initialize the async io for the worker */
-   ctx->io_ctx = worker_ioengine_init(ctx->max_pending_callbacks);
+   ctx->io_ctx = worker_ioengine_init(ctx->max_pending_callbacks, ctx->pagecache);
 
    /* Rebuild existing data structures */
-   size_t nb_slabs = sizeof(slab_sizes)/sizeof(*slab_sizes);
+   size_t nb_slabs = get_nb_slab_classes();
    ctx->slabs = malloc(nb_slabs*sizeof(*ctx->slabs));
    struct slab_callback *cb = malloc(sizeof(*cb));
    cb->cb = worker_slab_init_cb;
    for(size_t i = 0; i < nb_slabs; i++) {
-      ctx->slabs[i] = create_slab(ctx, ctx->worker_id, slab_sizes[i], cb);
+      ctx->slabs[i] = create_slab(ctx, ctx->worker_id, get_slab_class_size(i), cb);
    }
    free(cb);
+   if(SLAB_COMPACTION || SLAB_CLUSTERING)
+      ctx->compaction = compaction_init(ctx, ctx->worker_id, ctx->slabs, nb_slabs);
 
     __sync_add_and_fetch(&nb_workers_ready, 1);
 
@@ -355,14 +571,33 @@ static void *worker_slab_init(void *pdata) {
    while(1) {
       ctx->rdt++;
 
-      while(io_pending(ctx->io_ctx)) {
+      if(WRITE_BACK_CACHE)
+         worker_ioengine_flush_dirty_pages(ctx->io_ctx);
+
+      if(SHARED_PAGE_CACHE)
+         page_cache_rebalance();
+
+      if(PARTIAL_IO_COMPLETIONS) {
+         // Submit the new IOs and process the ones that have completed, don't wait for the others
          worker_ioengine_enqueue_ios(ctx->io_ctx); __1
          worker_ioengine_get_completed_ios(ctx->io_ctx); __2
          worker_ioengine_process_completed_ios(ctx->io_ctx); __3
+      } else {
+         while(io_pending(ctx->io_ctx)) {
+            worker_ioengine_enqueue_ios(ctx->io_ctx); __1
+            worker_ioengine_get_completed_ios(ctx->io_ctx); __2
+            worker_ioengine_process_completed_ios(ctx->io_ctx); __3
+         }
       }
 
+      if(SLAB_COMPACTION || SLAB_CLUSTERING)
+         compaction_step(ctx->compaction);
+
       volatile size_t pending = ctx->sent_callbacks - ctx->processed_callbacks;
-      while(!pending && !io_pending(ctx->io_ctx)) {
+      while(!pending && !io_pending(ctx->io_ctx) && !io_dirty_pages(ctx->io_ctx)) {
+         page_cache_release_pages(ctx->pagecache); // the page cache may have been shrunk while the worker is idle
+         if(SLAB_COMPACTION || SLAB_CLUSTERING)
+            compaction_step(ctx->compaction); // the IOs of the compaction end the wait
          if(!PINNING) {
             usleep(2);
          } else {
@@ -373,7 +608,7 @@ static void *worker_slab_init(void *pdata) {
 
       worker_dequeue_requests(ctx); __5 // Process queue
 
-      show_breakdown_periodic(1000, ctx->processed_callbacks, "io_submit", "io_getevents", "io_cb", "wait", "slab_cb");
+      show_breakdown_periodic_msg(1000, ctx->processed_callbacks, "io_submit", "io_getevents", "io_cb", "wait", "slab_cb", " - worker %lu - %s - %lu us stalled on slab extensions", ctx->worker_id, worker_ioengine_stats(ctx->io_ctx), slab_extension_stall_us());
    }
 
    return NULL;
@@ -385,6 +620,10 @@ void slab_workers_init(int _nb_disks, int nb_workers_per_disk) {
    nb_workers = nb_disks * nb_workers_per_disk;
 
    memory_index_init();
+   slab_classes_init(nb_disks);
+
+   if(NUMA_PLACEMENT)
+      numa_init(nb_disks, nb_workers_per_disk);
 
    pthread_t t;
    slab_contexts = calloc(nb_workers, sizeof(*slab_contexts));
@@ -392,18 +631,20 @@ void slab_workers_init(int _nb_disks, int nb_workers_per_disk) {
       struct slab_context *ctx = &slab_contexts[w];
       ctx->worker_id = w;
       ctx->max_pending_callbacks = max_pending_callbacks;
-      ctx->callbacks = calloc(ctx->max_pending_callbacks, sizeof(*ctx->callbacks));
       pthread_create(&t, NULL, worker_slab_init, ctx);
    }
 
    while(*(volatile int*)&nb_workers_ready != nb_workers) {
       NOP10();
    }
+
+   if(PAGECACHE_LAZY_INIT && PAGECACHE_PREFAULT_IN_BACKGROUND)
+      page_cache_prefault();
 }
 
 size_t get_database_size(void) {
    uint64_t size = 0;
-   size_t nb_slabs = sizeof(slab_sizes)/sizeof(*slab_sizes);
+   size_t nb_slabs = get_nb_slab_classes();
 
    size_t nb_workers = get_nb_workers();
    for(size_t w = 0; w < nb_workers; w++) {
@@ -415,3 +656,48 @@ size_t get_database_size(void) {
 
    return size;
 }
+
+/*
+ * Hit ratio of the page cache of each worker since the last call, and hit ratio per GB of cache to compare configurations.
+ * With the item cache, the hit ratio of both caches is the ratio of accesses that were served from memory (a hit of the item cache is a read
+ * that didn't access the page cache). Misses of the page cache are hits or misses of the compressed cache.
+ */
+void print_page_cache_stats(void) {
+   size_t nb_workers = get_nb_workers();
+   printf("#Page cache hit ratio:\n");
+   for(size_t w = 0; w < nb_workers; w++) {
+      struct pagecache *p = slab_contexts[w].pagecache;
+      size_t hits = p->hits - p->reported_hits;
+      size_t misses = p->misses - p->reported_misses;
+      p->reported_hits += hits;
+      p->reported_misses += misses;
+      size_t page_cache_mb = p->nb_pages * p->page_size / 1024 / 1024 + 1;
+      size_t ratio = (hits + misses)?hits*100/(hits + misses):0;
+      printf("#\tWorker %lu - %lu%% (%lu hits, %lu misses, %lu/%lu pages, %lu%% per GB)\n", w, ratio, hits, misses, p->nb_pages, p->max_pages, ratio*1024/page_cache_mb);
+
+      struct compressedcache *cc = p->compressed;
+      if(cc) {
+         size_t tier_hits = cc->hits - cc->reported_hits;
+         size_t tier_misses = cc->misses - cc->reported_misses;
+         cc->reported_hits += tier_hits;
+         cc->reported_misses += tier_misses;
+         printf("#\t\tcompressed cache %lu%% (%lu hits, %lu misses, %lu pages in %lu MB, compression ratio %.1f, %lu incompressible pages) - page cache + compressed cache %lu%%\n",
+               (tier_hits + tier_misses)?tier_hits*100/(tier_hits + tier_misses):0, tier_hits, tier_misses,
+               cc->nb_pages, cc->arena_size / 1024 / 1024, cc->compressed_bytes?(double)(cc->nb_pages * PAGE_SIZE)/cc->compressed_bytes:0., cc->rejected,
+               (hits + misses)?(hits + tier_hits)*100/(hits + misses):0);
+      }
+
+      struct itemcache *c = slab_contexts[w].itemcache;
+      if(!c)
+         continue;
+      size_t item_hits = c->hits - c->reported_hits;
+      size_t item_misses = c->misses - c->reported_misses;
+      c->reported_hits += item_hits;
+      c->reported_misses += item_misses;
+      size_t item_cache_mb = item_cache_memory(c) / 1024 / 1024;
+      size_t total_ratio = (item_hits + hits + misses)?(item_hits + hits)*100/(item_hits + hits + misses):0;
+      printf("#\t\titem cache %lu%% (%lu hits, %lu misses, %lu MB) - page cache + item cache %lu%% (%lu MB, %lu%% per GB)\n",
+            (item_hits + item_misses)?item_hits*100/(item_hits + item_misses):0, item_hits, item_misses, item_cache_mb,
+            total_ratio, page_cache_mb + item_cache_mb, total_ratio*1024/(page_cache_mb + item_cache_mb));
+   }
+}
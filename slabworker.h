@@ -5,6 +5,7 @@
 
 struct slab_callback;
 struct slab_context;
+struct migration;
 
 void kv_read_async(struct slab_callback *callback);
 void kv_add_async(struct slab_callback *callback);
@@ -17,12 +18,15 @@ tree_scan_res_t kv_init_scan(void *item, size_t scan_size);
 void kv_read_async_no_lookup(struct slab_callback *callback, struct slab *s, size_t slab_idx);
 
 size_t get_database_size(void);
+void print_page_cache_stats(void);
+void print_scan_stats(void);
 
 
 void slab_workers_init(int nb_disks, int nb_workers_per_disk);
 int get_nb_workers(void);
 void *kv_read_sync(void *item); // Unsafe
 struct pagecache *get_pagecache(struct slab_context *ctx);
+struct itemcache *get_itemcache(struct slab_context *ctx);
 struct io_context *get_io_context(struct slab_context *ctx);
 uint64_t get_rdt(struct slab_context *ctx);
 void set_rdt(struct slab_context *ctx, uint64_t val);
@@ -30,4 +34,9 @@ int get_worker(struct slab *s);
 int get_nb_disks(void);
 struct slab *get_item_slab(int worker_id, void *item);
 size_t get_item_size(char *item);
+void end_migration(struct slab_callback *callback);
+void resume_after_migration(struct migration *m);
+struct migration *begin_item_move(struct slab_context *ctx, struct slab_callback *callback, struct slab *old_slab, size_t old_slab_idx);
+void end_item_move(struct migration *m);
+int item_is_moving(struct slab_context *ctx, void *item);
 #endif
@@ -131,6 +131,7 @@
  *    ...
  *    show_breakdown_periodic(1000, "fun1", "fun2", ...); // "fun1 X% fun2 Y%" every second
  * }
+ * show_breakdown_periodic_msg(1000, "fun1", "fun2", ..., " - %lu", f()); also prints a message at the end of the line (f is only called when the line is printed).
  */
 #define declare_breakdown \
    struct __breakdown { \
@@ -184,6 +185,9 @@
    } while(0);
 
 #define show_breakdown_periodic(period, _count, _evt1, _evt2, _evt3, _evt4, _evt5) \
+   show_breakdown_periodic_msg(period, _count, _evt1, _evt2, _evt3, _evt4, _evt5, "")
+
+#define show_breakdown_periodic_msg(period, _count, _evt1, _evt2, _evt3, _evt4, _evt5, msg, args...) \
    do { \
       __breakdown.loops++; \
       rdtscll(__breakdown.now); \
@@ -191,7 +195,7 @@
       if(cycles_to_us(elapsed) > ((period)*1000LU)) { \
          uint64_t count_diff = _count - __breakdown.count; \
          __breakdown.count = _count; \
-         printf("[WORKER BREAKDOWN] " _evt1 "%3lu%% - " _evt2 " %3lu%% - " _evt3 " %3lu%% - " _evt4 " %3lu%% - " _evt5 " %3lu%% - %7lu ops - %7lu ops/s - %3lu ops / loop - %lu cycles/op\n", \
+         printf("[WORKER BREAKDOWN] " _evt1 "%3lu%% - " _evt2 " %3lu%% - " _evt3 " %3lu%% - " _evt4 " %3lu%% - " _evt5 " %3lu%% - %7lu ops - %7lu ops/s - %3lu ops / loop - %lu cycles/op" msg "\n", \
                __breakdown.evt1*100LU/elapsed, \
                __breakdown.evt2*100LU/elapsed, \
                __breakdown.evt3*100LU/elapsed, \
@@ -200,8 +204,8 @@
                count_diff, \
                count_diff * period * 1000 / cycles_to_us(elapsed), \
                count_diff/__breakdown.loops, \
-               elapsed / count_diff \
-               ); \
+               count_diff?elapsed / count_diff:0, \
+               ##args); \
          __breakdown.real_start = __breakdown.now; \
          __breakdown.evt1 = 0; \
          __breakdown.evt2 = 0; \
@@ -4,7 +4,7 @@
  * Create a workload item for the database
  */
 char *create_unique_item(size_t item_size, uint64_t uid) {
-   char *item = malloc(item_size);
+   char *item = pool_alloc(item_size);
    struct item_metadata *meta = (struct item_metadata *)item;
    meta->key_size = 8;
    meta->value_size = item_size - 8 - sizeof(*meta);
@@ -24,7 +24,7 @@ char *create_workload_item(struct workload *w) {
    size_t value_size = strlen(name) + 1;
 
    struct item_metadata *meta;
-   char *item = malloc(sizeof(*meta) + key_size + value_size);
+   char *item = pool_alloc(sizeof(*meta) + key_size + value_size);
    meta = (struct item_metadata *)item;
    meta->key_size = key_size;
    meta->value_size = value_size;
@@ -41,8 +41,8 @@ char *create_workload_item(struct workload *w) {
  */
 static void add_in_tree(struct slab_callback *cb, void *item) {
    memory_index_add(cb, item);
-   free(cb->item);
-   free(cb);
+   pool_free(cb->item);
+   pool_free(cb);
 }
 
 struct rebuild_pdata {
@@ -56,7 +56,7 @@ void *repopulate_db_worker(void *pdata) {
    declare_periodic_count;
    struct rebuild_pdata *data = pdata;
 
-   pin_me_on(get_nb_workers() + data->id);
+   pin_me_on(NUMA_PLACEMENT?numa_injector_core(data->id):(get_nb_workers() + data->id));
 
    size_t *pos = data->pos;
    struct workload *w = data->w;
@@ -64,9 +64,11 @@ void *repopulate_db_worker(void *pdata) {
    size_t start = data->start;
    size_t end = data->end;
    for(size_t i = start; i < end; i++) {
-      struct slab_callback *cb = malloc(sizeof(*cb));
+      struct slab_callback *cb = pool_alloc(sizeof(*cb));
       cb->cb = add_in_tree;
       cb->payload = NULL;
+      cb->ack = ACK_ON_DISK;
+      cb->scan = 0;
       cb->item = api->create_unique_item(pos[i], w->nb_items_in_db);
       kv_add_async(cb);
       periodic_count(1000, "Repopulating database (%lu%%)", 100LU-(end-i)*100LU/(end - start));
@@ -93,7 +95,7 @@ void repopulate_db(struct workload *w) {
    }
 
    if(nb_inserts == 0) {
-      free(workload_item);
+      pool_free(workload_item);
       return;
    }
 
@@ -101,9 +103,11 @@ void repopulate_db(struct workload *w) {
 
    // Say that this database is for that workload
    if(nb_items_already_in_db == 0) {
-      struct slab_callback *cb = malloc(sizeof(*cb));
+      struct slab_callback *cb = pool_alloc(sizeof(*cb));
       cb->cb = add_in_tree;
       cb->payload = NULL;
+      cb->ack = ACK_ON_DISK;
+      cb->scan = 0;
       cb->item = workload_item;
       kv_add_async(cb);
    } else {
@@ -171,13 +175,13 @@ void print_item(size_t idx, void* _item) {
  */
 void show_item(struct slab_callback *cb, void *item) {
    print_item(cb->slab_idx, item);
-   free(cb->item);
-   free(cb);
+   pool_free(cb->item);
+   pool_free(cb);
 }
 
 void free_callback(struct slab_callback *cb, void *item) {
-   free(cb->item);
-   free(cb);
+   pool_free(cb->item);
+   pool_free(cb);
 }
 
 void compute_stats(struct slab_callback *cb, void *item) {
@@ -198,17 +202,19 @@ void compute_stats(struct slab_callback *cb, void *item) {
                get_origin_from_payload(cb, 7), get_time_from_payload(cb, 7) < start ? 0 : cycles_to_us(get_time_from_payload(cb, 7) - start),
                cycles_to_us(end  - start));
       }
-      free(cb->item);
+      pool_free(cb->item);
       if(DEBUG)
          free_payload(cb);
-      free(cb);
+      pool_free(cb);
    } stop_debug_timer(5000, "Callback took more than 5ms???");
 }
 
 struct slab_callback *bench_cb(void) {
-   struct slab_callback *cb = malloc(sizeof(*cb));
+   struct slab_callback *cb = pool_alloc(sizeof(*cb));
    cb->cb = compute_stats;
    cb->payload = allocate_payload();
+   cb->ack = ACK_ON_CACHE; // only matters with WRITE_BACK_CACHE
+   cb->scan = 0;
    return cb;
 }
 
@@ -235,7 +241,7 @@ void* do_workload_thread(void *pdata) {
    struct thread_data *d = pdata;
 
    init_seed();
-   pin_me_on(get_nb_workers() + d->id);
+   pin_me_on(NUMA_PLACEMENT?numa_injector_core(d->id):(get_nb_workers() + d->id));
    pthread_barrier_wait(&barrier);
 
    d->workload->api->launch(d->workload, d->benchmark);
@@ -268,6 +274,10 @@ void run_workload(struct workload *w, bench_t b) {
       free(threads);
    } stop_timer("%s - %lu requests (%lu req/s)", w->api->name(b), w->nb_requests, w->nb_requests*1000000/elapsed);
    print_stats();
+   print_page_cache_stats();
+   print_scan_stats();
+   print_slab_classes_stats();
+   print_compaction_stats();
 
    free(pdata);
 }
@@ -33,11 +33,12 @@ static void launch_prod(struct workload *w, bench_t b) {
          kv_read_async(cb);
       } else {
          tree_scan_res_t scan_res = kv_init_scan(cb->item, uniform_next()%99+1);
-         free(cb->item);
-         free(cb);
+         pool_free(cb->item);
+         pool_free(cb);
          for(size_t j = 0; j < scan_res.nb_entries; j++) {
             cb = bench_cb();
             cb->item = create_unique_item_prod(scan_res.hashes[j], w->nb_items_in_db);
+            cb->scan = 1;
             kv_read_async_no_lookup(cb, scan_res.entries[j].slab, scan_res.entries[j].slab_idx);
          }
          free(scan_res.hashes);
@@ -61,10 +61,11 @@ static void _launch_ycsb_e(int test, int nb_requests, int zipfian) {
       } else {  // or we scan
          char *item = _create_unique_item_ycsb(rand_next());
          tree_scan_res_t scan_res = kv_init_scan(item, uniform_next()%99+1);
-         free(item);
+         pool_free(item);
          for(size_t j = 0; j < scan_res.nb_entries; j++) {
             struct slab_callback *cb = bench_cb();
             cb->item = _create_unique_item_ycsb(scan_res.hashes[j]);
+            cb->scan = 1;
             kv_read_async_no_lookup(cb, scan_res.entries[j].slab, scan_res.entries[j].slab_idx);
          }
          free(scan_res.hashes);